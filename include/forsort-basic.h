@@ -127,6 +127,118 @@ NAME(binary_search_rotate)(VAR *restrict pa, VAR *restrict pb, VAR *restrict pe,
 #endif
 
 
+// Returns where PK would go within the sorted PB->PE, ahead of any items that
+// are equal to it.  The search gallops out from PB first, so it's cheapest
+// when PK belongs close to the start
+static VAR *
+NAME(gallop_left)(VAR *restrict pk, VAR *pb, VAR *pe, COMMON_PARAMS)
+{
+	size_t	n = NITEM(pe - pb), lo = 0, hi = 1;
+
+	// Items before LO are less than PK, and the item at HI-1 is not
+	while ((hi <= n) && IS_LT(pb + ((hi - 1) * ES), pk)) {
+		lo = hi;
+		hi <<= 1;
+	}
+
+	if (hi > n)
+		hi = n + 1;
+
+	for (size_t mid, max = hi - 1; lo < max; ) {
+		mid = (lo + max) >> 1;
+		if (IS_LT(pb + (mid * ES), pk))
+			lo = mid + 1;
+		else
+			max = mid;
+	}
+
+	return pb + (lo * ES);
+} // gallop_left
+
+
+// Returns where PK would go within the sorted PA->PE, after any items that
+// are equal to it.  The search gallops back from PE first, so it's cheapest
+// when PK belongs close to the end
+static VAR *
+NAME(gallop_right)(VAR *restrict pk, VAR *pa, VAR *pe, COMMON_PARAMS)
+{
+	size_t	n = NITEM(pe - pa), lo = 0, hi = 1;
+
+	// The last LO items are greater than PK, and the item HI back is not
+	while ((hi <= n) && IS_LT(pk, pe - (hi * ES))) {
+		lo = hi;
+		hi <<= 1;
+	}
+
+	if (hi > n)
+		hi = n + 1;
+
+	size_t	min = n + 1 - hi, max = n - lo;
+
+	while (min < max) {
+		size_t	mid = (min + max) >> 1;
+		if (IS_LT(pk, pa + (mid * ES)))
+			max = mid;
+		else
+			min = mid + 1;
+	}
+
+	return pa + (min * ES);
+} // gallop_right
+
+
+// Merges PA->PB with PB->PE when one side fits in BASIC_BUF_SIZE and is far
+// smaller than the other.  The small side is copied out to the stack, and is
+// then walked through one item at a time, starting from the end furthest from
+// the large side.  Each item gallops to find where it goes, and the run of the
+// large side that it passes over is moved with a single memmove().  Every item
+// on the large side is moved at most once, so this is O(m log n + n) overall
+static void
+NAME(asymmetric_merge)(VAR *pa, VAR *pb, VAR *pe, COMMON_PARAMS)
+{
+	_Alignas(64) char buf[BASIC_BUF_SIZE];
+	VAR	*ws = (VAR *)buf, *pw, *pr, *pd;
+
+	if ((pb - pa) <= (pe - pb)) {
+		VAR	*we = ws + (pb - pa);
+
+		memcpy(ws, pa, (pb - pa) * sizeof(VAR));
+		for (pw = ws, pd = pa; pw < we; pw += ES) {
+			pr = CALL(gallop_left)(pw, pb, pe, COMMON_ARGS);
+			memmove(pd, pb, (pr - pb) * sizeof(VAR));
+			pd += (pr - pb);
+			pb = pr;
+			memcpy(pd, pw, es);
+			pd += ES;
+
+			// Everything that's left of A goes after all of B
+			if (pb == pe) {
+				memcpy(pd, pw + ES, (we - pw - ES) * sizeof(VAR));
+				return;
+			}
+		}
+	} else {
+		VAR	*we = ws + (pe - pb);
+
+		memcpy(ws, pb, (pe - pb) * sizeof(VAR));
+		for (pw = we - ES, pd = pe; pw >= ws; pw -= ES) {
+			pr = CALL(gallop_right)(pw, pa, pb, COMMON_ARGS);
+			pd -= (pb - pr);
+			memmove(pd, pr, (pb - pr) * sizeof(VAR));
+			pb = pr;
+			pd -= ES;
+			memcpy(pd, pw, es);
+
+			// Everything that's left of B goes before all of A
+			if (pb == pa) {
+				memcpy(pa, ws, (pw - ws) * sizeof(VAR));
+				return;
+			}
+		}
+	}
+} // asymmetric_merge
+
+
 // This algorithm appears to be viable now that I added the triple_shift_v2()
 // block rotation to Forsort.  I had tried this algorithm before, but with the
 // older block rotation it performed badly.  In fact this algorithm now
@@ -141,11 +253,13 @@ NAME(rotate_merge_in_place)(VAR *pa, VAR *pb, VAR *pe, COMMON_PARAMS)
 		return;
 
 	// The stack_size is * 3 due to three pointers per stack entry.  Even
-	// if we're asked to merge 2^64 items, the stack will be 1536 bytes
-	// in size (assuming pointers are 8 bytes in size)
-	size_t	bs, split_size, stack_size = msb64(NITEM(pb - pa)) * 3;
+	// if we're asked to merge 2^64 items, the stack will be 1560 bytes
+	// in size (assuming pointers are 8 bytes in size).  The +1 keeps the
+	// array from being zero-sized when A is a single item
+	size_t	bs, split_size, stack_size = (msb64(NITEM(pb - pa)) + 1) * 3;
 	_Alignas(64) VAR *stack_space[stack_size];
 	VAR	**work_stack = stack_space, *spa, *spb, *rp;
+	size_t	na, nb;
 
 rotate_again:
 	// Special case handling of single item merges
@@ -163,6 +277,15 @@ rotate_again:
 		goto rotate_pop;
 	}
 
+	// Merge a small block into a much larger one in a single pass
+	na = NITEM(bs);
+	nb = NITEM(pe - pb);
+	if ((ASYMMETRIC_RATIO > 0) && ((MIN(na, nb) * es) <= BASIC_BUF_SIZE) &&
+	    (((na * ASYMMETRIC_RATIO) <= nb) || ((nb * ASYMMETRIC_RATIO) <= na))) {
+		CALL(asymmetric_merge)(pa, pb, pe, COMMON_ARGS);
+		goto rotate_pop;
+	}
+
 	// Split block into half
 	// PA->PB will point at first half
 	// SPA->SPB points at second half
@@ -476,9 +599,244 @@ NAME(dereverse)(VAR *restrict curr, const size_t n, COMMON_PARAMS)
 } // dereverse
 
 
+//--------------------------------------------------------------------------
+//                 Parallel presortedness and run detection
+//--------------------------------------------------------------------------
+
+// Both of these scans compare every item against the one before it, and so
+// can be freely cut up into slices for multiple threads to work on.  Each
+// slice also compares its first item against the last item of the slice
+// before it, which stitches the slices back together without any fix-ups
+struct NAME(scan_job) {
+	VAR	*pa;
+	size_t	n, slice, es;
+	int	(*is_lt)(const void *, const void *);
+	int	order[MAX_THREADS];	// Order found in each slice
+	size_t	count[MAX_THREADS];	// Run starts found in each slice
+	size_t	*offsets;		// Where to write out the run starts
+	size_t	noffsets;
+	int	mixed;			// Set to stop all slices early
+};
+
+
+static int
+NAME(presorted_slice)(struct NAME(scan_job) *job, size_t index, COMMON_PARAMS)
+{
+	size_t	from = index * job->slice;
+	size_t	num = MIN(job->slice, job->n - from);
+	VAR	*curr = job->pa + (from * ES), *pe = curr + (num * ES);
+	int	order;
+
+	// Include the last item of the previous slice, if there is one
+	if (from > 0)
+		curr -= ES;
+
+	order = IS_LT(curr + ES, curr) ? ORDER_DESCENDING : ORDER_ASCENDING;
+
+	while ((curr += ES) < pe) {
+		// Check in regularly to see if another slice found disorder
+		size_t	batch = MIN(NITEM(pe - curr), 4096);
+
+		if (order == ORDER_ASCENDING) {
+			for ( ; batch--; curr += ES)
+				if (IS_LT(curr, curr - ES))
+					goto found_mixed;
+		} else {
+			for ( ; batch--; curr += ES)
+				if (!IS_LT(curr, curr - ES))
+					goto found_mixed;
+		}
+		curr -= ES;
+
+		if (__atomic_load_n(&job->mixed, __ATOMIC_RELAXED))
+			break;
+	}
+	return order;
+
+found_mixed:
+	__atomic_store_n(&job->mixed, 1, __ATOMIC_RELAXED);
+	return ORDER_MIXED;
+} // presorted_slice
+
+
+static void
+NAME(presorted_task)(void *arg, size_t index)
+{
+	struct NAME(scan_job) *job = arg;
+
+	job->order[index] = CALL(presorted_slice)(job, index, job->es, job->is_lt);
+} // presorted_task
+
+
+// Reverses the whole array.  Slice N swaps its items with the mirror image
+// of itself at the other end of the array
+static void
+NAME(reverse_slice)(struct NAME(scan_job) *job, size_t index, size_t es)
+{
+	size_t	from = index * job->slice;
+	size_t	num = MIN(job->slice, (job->n >> 1) - from);
+	VAR	*pa = job->pa + (from * ES);
+	VAR	*pe = job->pa + ((job->n - from) * ES);
+
+	while (num--) {
+		pe -= ES;
+		SWAP(pa, pe);
+		pa += ES;
+	}
+} // reverse_slice
+
+
+static void
+NAME(reverse_task)(void *arg, size_t index)
+{
+	struct NAME(scan_job) *job = arg;
+
+	CALL(reverse_slice)(job, index, job->es);
+} // reverse_task
+
+
+// Uses multiple threads to check if a large input is already sorted, or is
+// strictly reversed (which is then fixed up).  Returns true if the input is
+// now sorted, and false if it isn't (or wasn't large enough to check).  This
+// is strictly an accelerator for the serial checks that the sorts already do
+static bool
+NAME(parallel_presorted)(VAR *pa, const size_t n, COMMON_PARAMS)
+{
+	struct NAME(scan_job) job = {pa, n, 0, es, is_lt};
+	size_t	ntasks = parallel_slices(n, es, PARALLEL_SCAN_MIN, &job.slice);
+
+	if (ntasks < 2)
+		return false;
+
+	parallel_for(ntasks, CALL(presorted_task), &job);
+
+	for (size_t i = 1; i < ntasks; i++)
+		if (job.order[i] != job.order[0])
+			return false;
+
+	if (job.order[0] == ORDER_ASCENDING)
+		return true;
+
+	if (job.order[0] != ORDER_DESCENDING)
+		return false;
+
+	// Strictly descending input has no equal items, so just reversing
+	// the whole lot is sort-stable
+	if ((ntasks = parallel_slices(n >> 1, es, PARALLEL_SCAN_MIN, &job.slice)) < 2)
+		CALL(reverse_block)(pa, pa + (n * ES), es);
+	else
+		parallel_for(ntasks, CALL(reverse_task), &job);
+
+	return true;
+} // parallel_presorted
+
+
+// Counts the run starts within a slice, and if WRITE is set, then also writes
+// them out to the offsets list, starting from where the slices before left off
+static void
+NAME(find_runs_slice)(struct NAME(scan_job) *job, size_t index, bool write,
+			COMMON_PARAMS)
+{
+	size_t	from = index * job->slice;
+	size_t	num = MIN(job->slice, job->n - from);
+	size_t	pos = 0, count = 0, noffsets = job->noffsets;
+	size_t	*offsets = job->offsets;
+	VAR	*curr = job->pa + (from * ES), *pe = curr + (num * ES);
+
+	if (write) {
+		for (size_t i = 0; i < index; i++)
+			pos += job->count[i];
+		if (pos >= noffsets)
+			return;
+	}
+
+	// The very first item always starts a run
+	if (from == 0) {
+		if (write)
+			offsets[pos++] = 0;
+		count++;
+		curr += ES;
+	}
+
+	for (size_t at = NITEM(curr - job->pa); curr < pe; curr += ES, at++) {
+		if (IS_LT(curr, curr - ES)) {
+			count++;
+			if (write) {
+				if (pos >= noffsets)
+					return;
+				offsets[pos++] = at;
+			}
+		}
+	}
+
+	if (!write)
+		job->count[index] = count;
+} // find_runs_slice
+
+
+static void
+NAME(count_runs_task)(void *arg, size_t index)
+{
+	struct NAME(scan_job) *job = arg;
+
+	CALL(find_runs_slice)(job, index, false, job->es, job->is_lt);
+} // count_runs_task
+
+
+static void
+NAME(write_runs_task)(void *arg, size_t index)
+{
+	struct NAME(scan_job) *job = arg;
+
+	CALL(find_runs_slice)(job, index, true, job->es, job->is_lt);
+} // write_runs_task
+
+
+// Builds a map of the non-descending runs within the array.  Returns the
+// number of runs, K, and writes the first NOFFSETS of the K+1 run boundaries
+// (0, the start of each subsequent run, and then N) into OFFSETS.  The array
+// is not modified.  Large arrays are scanned using multiple threads
+static size_t
+NAME(find_runs)(VAR *pa, const size_t n, size_t *offsets, size_t noffsets, COMMON_PARAMS)
+{
+	struct NAME(scan_job) job = {pa, n, n, es, is_lt};
+	size_t	ntasks, nruns = 0;
+
+	if (n == 0) {
+		if (noffsets > 0)
+			offsets[0] = 0;
+		return 0;
+	}
+
+	if ((ntasks = parallel_slices(n, es, PARALLEL_SCAN_MIN, &job.slice)) < 2)
+		job.slice = n;
+
+	job.offsets = offsets;
+	job.noffsets = noffsets;
+
+	// Count the runs in each slice first, so that each slice then knows
+	// where to start writing its own runs out to the offsets list
+	parallel_for(ntasks, CALL(count_runs_task), &job);
+	for (size_t i = 0; i < ntasks; i++)
+		nruns += job.count[i];
+
+	if (noffsets > 0)
+		parallel_for(ntasks, CALL(write_runs_task), &job);
+
+	if (nruns < noffsets)
+		offsets[nruns] = n;
+
+	return nruns;
+} // find_runs
+
+
 static size_t
 NAME(basic_sort)(VAR *pa, const size_t n, COMMON_PARAMS)
 {
+	// Let multiple threads check if a large input is already in order
+	if (CALL(parallel_presorted)(pa, n, COMMON_ARGS))
+		return 0;
+
 	size_t	reversals = CALL(dereverse)(pa, n, COMMON_ARGS);
 
 	// Check if was fully sorted, or fully reversed
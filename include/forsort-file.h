@@ -0,0 +1,47 @@
+//				FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)	Copyright (C) 2021-2025
+//
+
+#ifndef FORSORT_FILE_H
+#define FORSORT_FILE_H
+
+// Options for sorting files of fixed size records.  All opts may be 0 to get
+// the defaults, and a NULL opts gets all of the defaults
+typedef struct forsort_file_opts {
+	size_t	memory;		// Bytes of memory to sort in.  0 uses half of RAM
+	const char *tmpdir;	// Where sorted runs go.  NULL uses $TMPDIR or /tmp
+} forsort_file_opts_t;
+
+// Sorts the ES sized records in the file IN into the file OUT, which may be
+// the same file.  Inputs that are larger than the memory budget are sorted in
+// chunks which are then merged.  Returns 0 on success, or -1 with errno set
+int forsort_file(const char *in, const char *out, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	const forsort_file_opts_t *opts);
+
+// Sorts the ES sized records read from IN_FD until end of file, and writes
+// them out to OUT_FD.  Neither needs to be seekable, so a pipeline can sort
+// streams of any length with memory use that stays within the budget.  Any
+// runs are spilled to temporary files.  Neither descriptor is closed.
+// Returns 0 on success, or -1 with errno set
+int forsort_file_fd(int in_fd, int out_fd, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	const forsort_file_opts_t *opts);
+
+// Sorts a stream of ES sized records in which no record is more than WINDOW
+// places away from where it belongs, reading from IN_FD until end of file and
+// writing to OUT_FD.  Memory use is about 3 * WINDOW records, and nothing is
+// written to disk.  Fails with ERANGE if a record turns up that is further out
+// of place than WINDOW allows, by which point the output is incomplete.
+// Returns 0 on success, or -1 with errno set
+int forsort_file_window(int in_fd, int out_fd, const size_t es,
+	int (*is_lt)(const void *, const void *), const size_t window);
+
+// Sorts the ES sized records in the file PATH in place, by mapping it into
+// memory and calling forsort_stable() on it.  No second copy of the file is
+// ever made, but it does need to fit in the page cache to sort at a decent
+// speed.  Returns 0 on success, or -1 with errno set
+int forsort_file_inplace(const char *path, const size_t es,
+	int (*is_lt)(const void *, const void *));
+#endif
@@ -0,0 +1,71 @@
+//                              FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)     Copyright (C) 2021-2025
+//
+// Huge page backed memory mappings.  Used by forsort.c for its own large
+// work-spaces, and by ts for its -H option, so that both get their huge pages
+// in exactly the same way.
+
+#ifndef FORSORT_HUGE_H
+#define FORSORT_HUGE_H
+
+#include <stddef.h>
+#include <sys/mman.h>
+
+#define	HUGE_PAGE_SIZE		((size_t)2 << 20)
+
+enum huge_kind {
+	HUGE_NONE = 0,		// A regular mapping, without any huge pages
+	HUGE_HUGETLB,		// Explicit huge pages that were reserved
+	HUGE_THP,		// Advised to use transparent huge pages
+};
+
+// Rounds SIZE up to a whole number of huge pages
+static inline size_t
+huge_round(size_t size)
+{
+	return (size + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+} // huge_round
+
+
+// Maps SIZE bytes, rounded up to whole huge pages.  Explicit huge pages
+// (MAP_HUGETLB) only exist if they've been reserved by the admin, so when
+// there are none we fall back to a regular mapping with a MADV_HUGEPAGE hint
+// for transparent huge pages.  If KIND isn't NULL, it's set to what we got.
+// Returns NULL if nothing could be mapped
+static inline void *
+huge_map(size_t size, enum huge_kind *kind)
+{
+	size_t	len = huge_round(size);
+	void	*p = MAP_FAILED;
+	enum huge_kind got = HUGE_NONE;
+
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+	p = mmap(NULL, len, PROT_READ | PROT_WRITE,
+		 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+	if (p != MAP_FAILED)
+		got = HUGE_HUGETLB;
+#endif
+	if (p == MAP_FAILED) {
+		p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (p == MAP_FAILED)
+			return NULL;
+#ifdef MADV_HUGEPAGE
+		if (madvise(p, len, MADV_HUGEPAGE) == 0)
+			got = HUGE_THP;
+#endif
+	}
+
+	if (kind)
+		*kind = got;
+	return p;
+} // huge_map
+
+
+// Unmaps what huge_map() mapped.  SIZE is the same size that was asked for
+static inline void
+huge_unmap(void *p, size_t size)
+{
+	munmap(p, huge_round(size));
+} // huge_unmap
+#endif
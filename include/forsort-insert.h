@@ -26,7 +26,7 @@ NAME(insertion_sort)(VAR *pa, const size_t n, COMMON_PARAMS)
 {
 	VAR	*pe = pa + (n * ES);
 
-	for (VAR *ta = pa + ES; ta != pe; ta += ES)
+	for (VAR *ta = pa + ES; ta < pe; ta += ES)
 		for (VAR *tb = ta; tb != pa && IS_LT(tb, tb - ES); tb -= ES)
 			SWAP(tb, tb - ES);
 } // insertion_sort_char
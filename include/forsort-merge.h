@@ -563,6 +563,65 @@ NAME(merge_workspace_constrained)(VAR *pa, size_t na, VAR *pb, size_t nb,
 } // merge_workspace_constrained
 
 
+// Merges the two adjacent sorted runs of PA->PA+NA and PA+NA->PA+NA+NB, using
+// whatever work-space we were given.  Everything at the start of A, and at the
+// end of B, that is already in its final place is trimmed off before starting
+// so that we only ever pay for the items that actually have to move
+static void
+NAME(merge_adjacent)(VAR *pa, size_t na, size_t nb, VAR *ws, const size_t nw,
+		     COMMON_PARAMS)
+{
+	if ((na == 0) || (nb == 0))
+		return;
+
+	VAR	*pb = pa + (na * ES), *pe = pb + (nb * ES);
+
+	// Check if we need to do anything at all!
+	if (!IS_LT(pb, pb - ES))
+		return;
+
+	// If all of B belongs before all of A, then just swap them over
+	if (IS_LT(pe - ES, pa))
+		return CALL(rotate_block)(pa, pb, pe, es);
+
+	// Skip the part of A that is <= the first item of B
+	size_t	min = 0, max = na, pos = max >> 1;
+	VAR	*sp = pa + (pos * ES);
+
+	while (min < max) {
+		// if (IS_LT(pb, sp))
+		//	max = pos;
+		// else
+		//	min = pos + 1;
+		int res = !!(IS_LT(pb, sp));
+		max = (max * !res) + (res * pos++);
+		min = (min * res) + (!res * pos);
+
+		pos = (min + max) >> 1;
+		sp = pa + (pos * ES);
+	}
+	pa = sp;
+
+	// Skip the part of B that is >= the last item of A
+	pe = CALL(binary_search_rotate)(pb - ES, pb, pe, COMMON_ARGS);
+
+	na = NITEM(pb - pa);
+	nb = NITEM(pe - pb);
+
+	// The trimming guarantees that the first item of B belongs before the
+	// first item of A, and the last item of A belongs after the last item
+	// of B, which is just what merge_left() and merge_right() expect
+	if (ws && (nb <= nw) && (nb < na))
+		CALL(merge_left)(pa, na, pb, nb, ws, nw, COMMON_ARGS);
+	else if (ws && (na <= nw))
+		CALL(merge_right)(pa, na, pb, nb, ws, nw, COMMON_ARGS);
+	else if (ws && (nw > 0))
+		CALL(merge_workspace_constrained)(pa, na, pb, nb, ws, nw, COMMON_ARGS);
+	else
+		CALL(rotate_merge_in_place)(pa, pb, pe, COMMON_ARGS);
+} // merge_adjacent
+
+
 // Restriction - ws cannot overlap with either p1 or p2
 static size_t
 NAME(bimerge_two_to_target)(VAR *restrict p1, VAR *restrict p2, size_t np,
@@ -846,6 +905,208 @@ NAME(sort_using_workspace)(VAR *pa, size_t n, VAR * const ws,
 } // sort_using_workspace
 
 
+//-----------------------------------------------------------------
+//           Start of sort_runs_using_workspace() code
+//-----------------------------------------------------------------
+
+// Natural runs shorter than this get extended out to this many items
+#define NATURAL_RUN_MIN		1024
+
+// The natural runs need to average at least this long to be worth merging
+// directly.  Anything more disordered goes to sort_using_workspace() instead
+#define NATURAL_RUN_AVG		4096
+
+// Returns the end of the natural run that starts at PA.  A run either never
+// descends, or always strictly descends.  Descending runs are reversed, which
+// is only sort-stable because they are strictly descending
+static VAR *
+NAME(natural_run)(VAR *pa, VAR * const pe, COMMON_PARAMS)
+{
+	VAR	*pt = pa + ES;
+
+	if (pt >= pe)
+		return pe;
+
+	if (!IS_LT(pt, pa)) {
+		for (pt += ES; (pt < pe) && !IS_LT(pt, pt - ES); pt += ES);
+		return pt;
+	}
+
+	for (pt += ES; (pt < pe) && IS_LT(pt, pt - ES); pt += ES);
+
+	for (VAR *pl = pa, *pr = pt - ES; pl < pr; pl += ES, pr -= ES)
+		SWAP(pl, pr);
+	return pt;
+} // natural_run
+
+
+// Returns the end of the next run, starting at PA, to be merged.  Natural runs
+// that are shorter than MIN are extended out to MIN items with a regular sort
+static VAR *
+NAME(next_run)(VAR *pa, VAR * const pe, const size_t min, VAR * const ws,
+	       const size_t nw, COMMON_PARAMS)
+{
+	VAR	*pt = CALL(natural_run)(pa, pe, COMMON_ARGS);
+
+	if (NITEM(pt - pa) < min) {
+		pt = (NITEM(pe - pa) < min) ? pe : pa + (min * ES);
+		CALL(sort_using_workspace)(pa, NITEM(pt - pa), ws, nw, COMMON_ARGS);
+	}
+	return pt;
+} // next_run
+
+
+// Powersort's node power of the boundary between the two adjacent runs of
+// S1->S1+N1 and S1+N1->S1+N1+N2, within an array of N items.  This is just
+// the number of leading bits that the two run mid-points have in common, when
+// they are both expressed as fractions of N
+static size_t
+NAME(natural_power)(size_t s1, size_t n1, size_t n2, size_t n)
+{
+	size_t	a = s1 + s1 + n1, b = a + n1 + n2, power = 0;
+
+	for (;;) {
+		power++;
+		if (a >= n) {
+			a -= n;
+			b -= n;
+		} else if (b >= n) {
+			break;
+		}
+		a <<= 1;
+		b <<= 1;
+	}
+	return power;
+} // natural_power
+
+
+struct NAME(run_stack) {
+	VAR	*pa;
+	size_t	power;
+};
+
+#define RUN_STACK_MAX	66
+
+// Pushes the run RS->RE, within the N items starting at PA, onto the STACK
+// ahead of the run RE->NE that follows it.  Any runs on the stack that have a
+// boundary of a higher power than the one between RS->RE and RE->NE get merged
+// with RS->RE first.  Returns how many runs are now on the stack
+static size_t
+NAME(push_run)(struct NAME(run_stack) *stack, size_t top, VAR *pa, const size_t n,
+	       VAR *rs, VAR *re, VAR *ne, VAR * const ws, const size_t nw, COMMON_PARAMS)
+{
+	size_t	power = CALL(natural_power)(NITEM(rs - pa), NITEM(re - rs),
+					    NITEM(ne - re), n);
+
+	while ((top > 0) && (stack[top - 1].power > power)) {
+		top--;
+		CALL(merge_adjacent)(stack[top].pa, NITEM(rs - stack[top].pa),
+				     NITEM(re - rs), ws, nw, COMMON_ARGS);
+		rs = stack[top].pa;
+	}
+
+	ASSERT(top < RUN_STACK_MAX);
+	stack[top].pa = rs;
+	stack[top].power = power;
+	return top + 1;
+} // push_run
+
+
+// Merges everything left on the STACK together with the final run RS->RE
+static void
+NAME(collapse_runs)(struct NAME(run_stack) *stack, size_t top, VAR *rs, VAR *re,
+		    VAR * const ws, const size_t nw, COMMON_PARAMS)
+{
+	while (top > 0) {
+		top--;
+		CALL(merge_adjacent)(stack[top].pa, NITEM(rs - stack[top].pa),
+				     NITEM(re - rs), ws, nw, COMMON_ARGS);
+		rs = stack[top].pa;
+	}
+} // collapse_runs
+
+
+// A sort that adapts to any natural runs that are present in PA->PA+N.  If
+// they are long enough on average, then the runs are merged with a balanced
+// Powersort style merge policy, otherwise it's just sort_using_workspace()
+//
+// Each new run is compared with the one before it to give the power of the
+// boundary between them.  Any runs on the stack with a boundary of a higher
+// power are merged first.  This keeps the merges very nearly balanced, while
+// only ever merging adjacent runs, and the stack never goes deeper than the
+// number of bits in N.  Checking the average run length first means that
+// random data only pays for a few comparisons before giving up on it
+static void
+NAME(sort_runs_using_workspace)(VAR *pa, const size_t n, VAR * const ws,
+				const size_t nw, COMMON_PARAMS)
+{
+	struct NAME(run_stack) stack[RUN_STACK_MAX];
+	VAR	*pe = pa + (n * ES);
+	size_t	top = 0, min = MIN(NATURAL_RUN_MIN, nw + nw);
+	size_t	limit = n / NATURAL_RUN_AVG;
+
+	if (limit < 2)
+		return CALL(sort_using_workspace)(pa, n, ws, nw, COMMON_ARGS);
+
+	// Check that the natural runs aren't too short to be worthwhile.  This
+	// also puts all the descending runs into order, and if there was only
+	// the one run, then we're already done
+	if (CALL(natural_run)(pa, pe, COMMON_ARGS) == pe)
+		return;
+
+	for (VAR *pt = pa; pt < pe; limit--) {
+		if (limit == 0)
+			return CALL(sort_using_workspace)(pa, n, ws, nw, COMMON_ARGS);
+		pt = CALL(natural_run)(pt, pe, COMMON_ARGS);
+	}
+
+	// RS->RE is the run that we're currently looking at
+	VAR	*rs = pa, *re = CALL(next_run)(pa, pe, min, ws, nw, COMMON_ARGS);
+
+	while (re < pe) {
+		VAR	*ne = CALL(next_run)(re, pe, min, ws, nw, COMMON_ARGS);
+
+		top = CALL(push_run)(stack, top, pa, n, rs, re, ne, ws, nw, COMMON_ARGS);
+		rs = re;
+		re = ne;
+	}
+	CALL(collapse_runs)(stack, top, rs, re, ws, nw, COMMON_ARGS);
+} // sort_runs_using_workspace
+
+
+// Merges K adjacent sorted runs together.  OFFSETS holds the K+1 fence posts
+// of the runs, as item offsets from PA, and so the K'th run is found between
+// PA+OFFSETS[K-1] and PA+OFFSETS[K].  The runs are merged in the same balanced
+// order as the natural runs are in sort_runs_using_workspace(), and so no item
+// gets moved more than about log2(K) times, however uneven the runs might be
+static void
+NAME(kmerge)(VAR *pa, const size_t *offsets, const size_t k, VAR * const ws,
+	     const size_t nw, COMMON_PARAMS)
+{
+	if (k < 2)
+		return;
+
+	struct NAME(run_stack) stack[RUN_STACK_MAX];
+	VAR	*rs = pa + (offsets[0] * ES), *re = pa + (offsets[1] * ES);
+	size_t	top = 0, n = offsets[k] - offsets[0];
+
+	for (size_t i = 2; i <= k; i++) {
+		VAR	*ne = pa + (offsets[i] * ES);
+
+		// Skip over any empty runs
+		if (ne == re)
+			continue;
+
+		if (re > rs)
+			top = CALL(push_run)(stack, top, pa + (offsets[0] * ES), n,
+					     rs, re, ne, ws, nw, COMMON_ARGS);
+		rs = re;
+		re = ne;
+	}
+	CALL(collapse_runs)(stack, top, rs, re, ws, nw, COMMON_ARGS);
+} // kmerge
+
+
 // Base merge-sort algorithm - I'm all 'bout that speed baby!
 // It logically follows that if this is given unique items to sort
 // then the result will naturally yield a sort-stable result
@@ -859,7 +1120,7 @@ NAME(merge_sort_in_place)(VAR * const pa, const size_t n, VAR * const ws,
 
 	// If we were handed a workspace, then just use that
 	if (ws && (nw > 0))
-		return CALL(sort_using_workspace)(pa, n, ws, nw, COMMON_ARGS);
+		return CALL(sort_runs_using_workspace)(pa, n, ws, nw, COMMON_ARGS);
 
 	// Otherwise we need to create our own workspace from the data given
 	// 9 appears to be close to optimal, but anything from 3-20 works
@@ -874,7 +1135,7 @@ NAME(merge_sort_in_place)(VAR * const pa, const size_t n, VAR * const ws,
 	size_t	nb = n - na;
 
 	// Sort B using A as the workspace
-	CALL(sort_using_workspace)(pb, nb, pa, na, COMMON_ARGS);
+	CALL(sort_runs_using_workspace)(pb, nb, pa, na, COMMON_ARGS);
 
 	// Now recursively sort the workspace we had split off
 	CALL(merge_sort_in_place)(pa, na, NULL, 0, COMMON_ARGS);
@@ -884,6 +1145,34 @@ NAME(merge_sort_in_place)(VAR * const pa, const size_t n, VAR * const ws,
 } // merge_sort_in_place
 
 
+// Sorts the NB new items that have been appended at PA+NA onto the end of the
+// sorted PA->PA+NA, and merges them in.  Only the new items are ever sorted.
+// The common case of the new items already being in order is caught with one
+// linear scan, and if they also all belong after the sorted items then that's
+// found by merge_adjacent() with a single compare.  With a work-space the end
+// result is sort-stable.  Without one, the new items are sorted in-place with
+// merge_sort_in_place(), which is faster but doesn't keep them stable
+static void
+NAME(append_sorted)(VAR *pa, const size_t na, const size_t nb, VAR *ws,
+		    const size_t nw, COMMON_PARAMS)
+{
+	if (nb == 0)
+		return;
+
+	VAR	*pb = pa + (na * ES), *pe = pb + (nb * ES);
+	VAR	*pt = pb + ES;
+
+	// Check if the new items are already sorted
+	while ((pt < pe) && !IS_LT(pt, pt - ES))
+		pt += ES;
+
+	if (pt < pe)
+		CALL(merge_sort_in_place)(pb, nb, ws, nw, COMMON_ARGS);
+
+	CALL(merge_adjacent)(pa, na, nb, ws, nw, COMMON_ARGS);
+} // append_sorted
+
+
 //-----------------------------------------------------------------
 //                        #define cleanup
 //-----------------------------------------------------------------
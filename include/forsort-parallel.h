@@ -0,0 +1,416 @@
+//                              FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)     Copyright (C) 2021-2025
+//
+// This is my implementation of what I believe to be an O(nlogn) time-complexity
+// O(logn) space-complexity, in-place and adaptive merge-sort style algorithm.
+//
+//                             parallel_sort()
+//
+// The input is cut into one chunk per thread, and each thread sorts its own
+// chunk using its own private work-space.  The sorted chunks are then merged
+// together in pairs, over log2(threads) rounds.  To keep all threads busy in
+// the later rounds, each pairwise merge is itself split into independent
+// sub-merges.  We pick a split point in the larger of the two sorted runs,
+// binary search for where it lands in the other run, and then rotate_block()
+// the two inner parts past each other.  What results is two smaller merges
+// that don't overlap with each other, and we keep on splitting until we have
+// enough of them to hand one to every thread.
+//
+// When running on a multi-node NUMA machine, the chunks are grouped by node.
+// Each thread is pinned to the CPUs of the node that owns its chunk, that
+// chunk is migrated over to that node's memory (if it isn't already there),
+// and the thread's work-space is allocated from that node too.  This confines
+// all of the cross-node memory traffic to the final merge rounds.
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+#define CONCAT(x, y) x ## _ ## y
+#define MAKE_STR(x, y) CONCAT(x,y)
+#define NAME(x) MAKE_STR(x, VAR)
+#define CALL(x) NAME(x)
+
+//-----------------------------------------------------------------
+//               Start of parallel_sort() implementation
+//-----------------------------------------------------------------
+
+// All sizes are in numbers of items, not bytes
+struct NAME(parallel_state) {
+	VAR	*pa;				// Start of the array
+	size_t	es;				// Item size in bytes
+	int	(*is_lt)(const void *, const void *);
+	const struct numa_topology *topo;	// NULL when not NUMA aware
+	struct forsort_ctx *ctx;		// Where to get work-spaces from
+	size_t	ntasks;				// No. of threads we're using
+	size_t	bounds[MAX_THREADS + 1];	// Chunk boundaries
+	size_t	node[MAX_THREADS];		// Node each task runs on
+	VAR	*ws[MAX_THREADS];		// Each task's private work-space
+	size_t	nw[MAX_THREADS];		// Size of each work-space
+	size_t	nmerges;			// Number of pending merges
+	VAR	*merges[MAX_THREADS][3];	// PA/PB/PE of each pending merge
+};
+
+
+// Merges PA->PB with PB->PE using whatever work-space we managed to get
+static void
+NAME(parallel_merge)(VAR *pa, VAR *pb, VAR *pe, VAR *ws, size_t nw, COMMON_PARAMS)
+{
+	size_t	na = NITEM(pb - pa), nb = NITEM(pe - pb);
+
+	if ((na == 0) || (nb == 0))
+		return;
+
+	if (ws && (nw > 0))
+		CALL(merge_workspace_constrained)(pa, na, pb, nb, ws, nw, COMMON_ARGS);
+	else
+		CALL(rotate_merge_in_place)(pa, pb, pe, COMMON_ARGS);
+} // parallel_merge
+
+
+// Splits the merge of PA->PB with PB->PE into (up to) K independent merges,
+// and adds each of them to the list of pending merges in the state
+static void
+NAME(parallel_split)(struct NAME(parallel_state) *state, VAR *pa, VAR *pb,
+		     VAR *pe, size_t k, COMMON_PARAMS)
+{
+	size_t	na = NITEM(pb - pa), nb = NITEM(pe - pb);
+	VAR	*sa, *sb;
+
+	if ((na == 0) || (nb == 0))
+		return;
+
+	// Check if we need to do anything at all
+	if (!IS_LT(pb, pb - ES))
+		return;
+
+	if ((k < 2) || (((na + nb) * es) < PARALLEL_SORT_MIN)) {
+		ASSERT(state->nmerges < MAX_THREADS);
+		state->merges[state->nmerges][0] = pa;
+		state->merges[state->nmerges][1] = pb;
+		state->merges[state->nmerges][2] = pe;
+		state->nmerges++;
+		return;
+	}
+
+	if (na >= nb) {
+		// Split A in half, and find the first item in B that is not
+		// less than where we split A.  Items in B that are equal to
+		// the split item must stay to its right to remain stable
+		sa = pa + ((na >> 1) * ES);
+		sb = CALL(binary_search_rotate)(sa, pb, pe, COMMON_ARGS);
+	} else {
+		// Split B in half, and find the first item in A that is
+		// greater than where we split B
+		size_t	min = 0, max = na, pos = max >> 1;
+
+		sb = pb + ((nb >> 1) * ES);
+		sa = pa + (pos * ES);
+		while (min < max) {
+			// if (IS_LT(sb, sa))
+			//	max = pos;
+			// else
+			//	min = pos + 1;
+			int res = !!(IS_LT(sb, sa));
+			max = (max * !res) + (res * pos++);
+			min = (min * res) + (!res * pos);
+
+			pos = (min + max) >> 1;
+			sa = pa + (pos * ES);
+		}
+	}
+
+	// SA->PB is now everything in A that belongs to the right of the
+	// split, and PB->SB is everything in B that belongs to the left
+	CALL(rotate_block)(sa, pb, sb, es);
+
+	VAR	*pm = sa + (sb - pb);
+
+	CALL(parallel_split)(state, pa, sa, pm, k >> 1, COMMON_ARGS);
+	CALL(parallel_split)(state, pm, sb, pe, k - (k >> 1), COMMON_ARGS);
+} // parallel_split
+
+
+static void
+NAME(parallel_sort_task)(void *arg, size_t index)
+{
+	struct NAME(parallel_state) *state = arg;
+	int	(*is_lt)(const void *, const void *) = state->is_lt;
+	const struct numa_topology *topo = state->topo;
+	size_t	es = state->es, node = state->node[index];
+	size_t	n = state->bounds[index + 1] - state->bounds[index];
+	VAR	*pa = state->pa + (state->bounds[index] * ES);
+	size_t	nw = ctx_workspace_size(state->ctx, n, es) / es;
+	VAR	*ws;
+	cpu_set_t prev;
+	bool	pinned = false;
+
+	if (topo) {
+		pinned = node_pin_thread(topo, node, &prev);
+#if NUMA_MIGRATE
+		node_migrate(topo, pa, n * es, node);
+#endif
+	}
+
+	// We hang on to the work-space as we'll re-use it for the merges
+	ws = ctx_workspace_get(state->ctx, index, nw * es, topo, node);
+
+	state->ws[index] = ws;
+	state->nw[index] = ws ? nw : 0;
+
+	// Without a work-space, only stable_sort() can keep us sort-stable
+	if (ws)
+		CALL(merge_sort_in_place)(pa, n, ws, nw, COMMON_ARGS);
+	else
+		CALL(stable_sort)(pa, n, COMMON_ARGS);
+
+	if (pinned)
+		node_unpin_thread(&prev);
+} // parallel_sort_task
+
+
+static void
+NAME(parallel_merge_task)(void *arg, size_t index)
+{
+	struct NAME(parallel_state) *state = arg;
+	int	(*is_lt)(const void *, const void *) = state->is_lt;
+	size_t	es = state->es;
+	VAR	**m = state->merges[index];
+	cpu_set_t prev;
+	bool	pinned = false;
+
+	// The merges are listed in array order, so merge N will mostly
+	// cover the same memory as chunk N did, which is on node N
+	if (state->topo)
+		pinned = node_pin_thread(state->topo, state->node[index], &prev);
+
+	CALL(parallel_merge)(m[0], m[1], m[2], state->ws[index], state->nw[index], COMMON_ARGS);
+
+	if (pinned)
+		node_unpin_thread(&prev);
+} // parallel_merge_task
+
+
+static void
+NAME(parallel_sort)(VAR * const pa, const size_t n, size_t nthreads,
+		    struct forsort_ctx *ctx, COMMON_PARAMS)
+{
+	struct NAME(parallel_state) state_real = {0}, *state = &state_real;
+	size_t	runs[MAX_THREADS + 1], nruns;
+
+	if ((nthreads == 0) || (nthreads > parallel_threads()))
+		nthreads = parallel_threads();
+
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	// Make sure every thread has a decent amount of work to do
+	if (nthreads > ((n * es) / PARALLEL_SORT_MIN))
+		nthreads = (n * es) / PARALLEL_SORT_MIN;
+
+	if (nthreads < 2) {
+		size_t	nw = ctx_workspace_size(ctx, n, es) / es;
+		VAR	*ws = ctx_workspace_get(ctx, 0, nw * es, NULL, 0);
+
+		if (ws)
+			CALL(merge_sort_in_place)(pa, n, ws, nw, COMMON_ARGS);
+		else
+			CALL(stable_sort)(pa, n, COMMON_ARGS);
+		ctx_workspace_put(ctx, ws, nw * es, NULL);
+		return;
+	}
+
+	state->ctx = ctx;
+	state->pa = pa;
+	state->es = es;
+	state->is_lt = is_lt;
+	state->ntasks = nthreads;
+#if NUMA_AWARE
+	state->topo = node_get_topology();
+#endif
+
+	for (size_t i = 0; i <= nthreads; i++)
+		state->bounds[i] = (n * i) / nthreads;
+
+	// Hand out tasks to the nodes in proportion to how many CPUs each
+	// node has.  Tasks are handed out in order, so that each node ends
+	// up with one contiguous region of the array to look after
+	if (state->topo) {
+		const struct numa_topology *topo = state->topo;
+		size_t	node = 0, limit = topo->ncpus[0];
+
+		for (size_t i = 0; i < nthreads; i++) {
+			while (((i * topo->total_cpus) >= (limit * nthreads)) &&
+			       ((node + 1) < topo->nnodes))
+				limit += topo->ncpus[++node];
+			state->node[i] = node;
+		}
+	}
+
+	// Sort all the chunks
+	parallel_for(nthreads, CALL(parallel_sort_task), state);
+
+	// Now merge them together in pairs until there's only one left
+	memcpy(runs, state->bounds, sizeof(runs));
+	for (nruns = nthreads; nruns > 1; nruns = (nruns + 1) >> 1) {
+		size_t	npairs = nruns >> 1;
+		size_t	per_pair = nthreads / npairs;
+
+		state->nmerges = 0;
+		for (size_t i = 0; i < npairs; i++) {
+			VAR	*p1 = pa + (runs[i * 2] * ES);
+			VAR	*p2 = pa + (runs[i * 2 + 1] * ES);
+			VAR	*p3 = pa + (runs[i * 2 + 2] * ES);
+
+			CALL(parallel_split)(state, p1, p2, p3, per_pair, COMMON_ARGS);
+		}
+
+		parallel_for(state->nmerges, CALL(parallel_merge_task), state);
+
+		// Collapse the run boundaries for the next round
+		for (size_t i = 0; i <= (nruns >> 1); i++)
+			runs[i] = runs[i * 2];
+		runs[(nruns + 1) >> 1] = n;
+	}
+
+	for (size_t i = 0; i < nthreads; i++)
+		ctx_workspace_put(ctx, state->ws[i], state->nw[i] * es, state->topo);
+} // parallel_sort
+
+
+//-----------------------------------------------------------------
+//                Start of batch_sort() implementation
+//-----------------------------------------------------------------
+
+// The number of arrays that a thread claims at a time in batch_sort()
+#define BATCH_CLAIM	32
+
+struct NAME(batch_state) {
+	VAR * const	*arrays;
+	const size_t	*counts;
+	size_t		k;
+	size_t		es;
+	int		(*is_lt)(const void *, const void *);
+	struct forsort_ctx *ctx;
+	size_t		next;			// Next array to be claimed
+};
+
+
+// Sorts a single small array directly, bypassing all the set-up that the
+// general sorts do.  All of these are sort-stable
+static void
+NAME(batch_sort_one)(VAR *pa, const size_t n, VAR *ws, size_t nw, COMMON_PARAMS)
+{
+	switch (n) {
+	case 0:
+	case 1:
+		return;
+	case 2:
+		return CALL(sort_two)(pa, COMMON_ARGS);
+	case 3:
+		return CALL(sort_three)(pa, COMMON_ARGS);
+	case 4:
+		return CALL(sort_four)(pa, COMMON_ARGS);
+	case 5:
+		return CALL(sort_five)(pa, COMMON_ARGS);
+	case 6:
+		return CALL(sort_six)(pa, COMMON_ARGS);
+	case 7:
+		return CALL(sort_seven)(pa, COMMON_ARGS);
+	case 8:
+		return CALL(sort_eight)(pa, COMMON_ARGS);
+	}
+
+	if (n <= BASIC_INSERT_MAX)
+		return CALL(insertion_sort)(pa, n, COMMON_ARGS);
+
+	// Without a work-space, only stable_sort() can keep us sort-stable
+	if (ws && (nw > 0))
+		CALL(merge_sort_in_place)(pa, n, ws, nw, COMMON_ARGS);
+	else
+		CALL(stable_sort)(pa, n, COMMON_ARGS);
+} // batch_sort_one
+
+
+static void
+NAME(batch_sort_task)(void *arg, size_t index)
+{
+	struct NAME(batch_state) *state = arg;
+	int	(*is_lt)(const void *, const void *) = state->is_lt;
+	size_t	es = state->es, k = state->k, have = 0;
+	VAR	*ws = NULL;
+
+	// Most arrays will be small enough to get by with a stack work-space
+	_Alignas(64) char stack_ws[BASIC_BUF_SIZE];
+
+	for (;;) {
+		size_t	pos = __atomic_fetch_add(&state->next, BATCH_CLAIM, __ATOMIC_RELAXED);
+
+		if (pos >= k)
+			break;
+
+		for (size_t end = MIN(pos + BATCH_CLAIM, k); pos < end; pos++) {
+			size_t	n = state->counts[pos];
+			size_t	size = ctx_workspace_size(state->ctx, n, es);
+
+			if (size <= BASIC_BUF_SIZE) {
+				CALL(batch_sort_one)(state->arrays[pos], n, (VAR *)stack_ws,
+						     BASIC_BUF_SIZE / es, COMMON_ARGS);
+				continue;
+			}
+
+			// Grow our heap work-space if it's too small.  Doubling
+			// it each time limits how often we reallocate it
+			if (size > have) {
+				ctx_workspace_put(state->ctx, ws, have, NULL);
+				if (size < (have << 1))
+					size = have << 1;
+				ws = ctx_workspace_get(state->ctx, index, size, NULL, 0);
+				have = ws ? size : 0;
+			}
+
+			CALL(batch_sort_one)(state->arrays[pos], n, ws, have / es, COMMON_ARGS);
+		}
+	}
+
+	ctx_workspace_put(state->ctx, ws, have, NULL);
+} // batch_sort_task
+
+
+// Sorts K independent arrays, with the Nth array at ARRAYS[N] holding COUNTS[N]
+// items.  The arrays are handed out to the threads BATCH_CLAIM at a time, and
+// each thread sorts its arrays one after another with its own work-space
+static void
+NAME(batch_sort)(VAR * const *arrays, const size_t *counts, const size_t k,
+		 struct forsort_ctx *ctx, COMMON_PARAMS)
+{
+	struct NAME(batch_state) state = {arrays, counts, k, es, is_lt, ctx, 0};
+	size_t	total = 0, ntasks = parallel_threads();
+
+	for (size_t i = 0; i < k; i++)
+		total += counts[i];
+
+	// Make sure every thread has a decent amount of work to do
+	if (ntasks > ((total * es) / PARALLEL_SORT_MIN))
+		ntasks = (total * es) / PARALLEL_SORT_MIN;
+
+	if (ntasks > ((k + BATCH_CLAIM - 1) / BATCH_CLAIM))
+		ntasks = (k + BATCH_CLAIM - 1) / BATCH_CLAIM;
+
+	if (ntasks < 1)
+		ntasks = 1;
+
+	parallel_for(ntasks, CALL(batch_sort_task), &state);
+} // batch_sort
+
+
+//-----------------------------------------------------------------
+//                        #define cleanup
+//-----------------------------------------------------------------
+
+#undef BATCH_CLAIM
+#undef CONCAT
+#undef MAKE_STR
+#undef NAME
+#undef CALL
+#pragma GCC diagnostic pop
@@ -344,6 +344,105 @@ NAME(ring_negative)(VAR * restrict pa, VAR * restrict po,
 } // ring_negative
 
 
+// Each of two_way_swap_block(), ring_positive() and ring_negative() exchange
+// items between disjoint ranges, where item i only ever interacts with item i
+// of the other ranges.  This makes them trivially divisible into slices for
+// multiple threads to work on at once.  We only bother with doing so when a
+// single exchange is larger than PARALLEL_ROTATE_MIN bytes in size though, as
+// that's the only time that a single core cannot keep up with the memory bus
+struct NAME(exchange_job) {
+	VAR	*pa, *po, *pb;
+	size_t	num, slice, es;
+};
+
+static void
+NAME(two_way_swap_task)(void *arg, size_t index)
+{
+	struct NAME(exchange_job) *job = arg;
+	size_t	es = job->es, from = index * job->slice;
+	size_t	num = MIN(job->slice, job->num - from);
+
+	CALL(two_way_swap_block)(job->pa + (from * ES), job->pb + (from * ES), num, es);
+} // two_way_swap_task
+
+
+static void
+NAME(ring_positive_task)(void *arg, size_t index)
+{
+	struct NAME(exchange_job) *job = arg;
+	size_t	es = job->es, from = index * job->slice;
+	size_t	num = MIN(job->slice, job->num - from);
+
+	CALL(ring_positive)(job->pa + (from * ES), job->po + (from * ES),
+			    job->pb + (from * ES), num, es);
+} // ring_positive_task
+
+
+// ring_negative() works backwards from the end pointers it is given, and so
+// each slice is measured backwards from the ends of the ranges too
+static void
+NAME(ring_negative_task)(void *arg, size_t index)
+{
+	struct NAME(exchange_job) *job = arg;
+	size_t	es = job->es, from = index * job->slice;
+	size_t	num = MIN(job->slice, job->num - from);
+
+	CALL(ring_negative)(job->pa - (from * ES), job->po - (from * ES),
+			    job->pb - (from * ES), num, es);
+} // ring_negative_task
+
+
+static inline void
+NAME(two_way_swap_block_mt)(VAR *pa, VAR *pb, size_t num, size_t es)
+{
+	size_t	slice, ntasks;
+
+	if ((num * es) < PARALLEL_ROTATE_MIN)
+		return CALL(two_way_swap_block)(pa, pb, num, es);
+
+	if ((ntasks = parallel_slices(num, es, PARALLEL_ROTATE_MIN, &slice)) < 2)
+		return CALL(two_way_swap_block)(pa, pb, num, es);
+
+	struct NAME(exchange_job) job = {pa, NULL, pb, num, slice, es};
+
+	parallel_for(ntasks, CALL(two_way_swap_task), &job);
+} // two_way_swap_block_mt
+
+
+static inline void
+NAME(ring_positive_mt)(VAR *pa, VAR *po, VAR *pb, size_t num, size_t es)
+{
+	size_t	slice, ntasks;
+
+	if ((num * es) < PARALLEL_ROTATE_MIN)
+		return CALL(ring_positive)(pa, po, pb, num, es);
+
+	if ((ntasks = parallel_slices(num, es, PARALLEL_ROTATE_MIN, &slice)) < 2)
+		return CALL(ring_positive)(pa, po, pb, num, es);
+
+	struct NAME(exchange_job) job = {pa, po, pb, num, slice, es};
+
+	parallel_for(ntasks, CALL(ring_positive_task), &job);
+} // ring_positive_mt
+
+
+static inline void
+NAME(ring_negative_mt)(VAR *pa, VAR *po, VAR *pb, size_t num, size_t es)
+{
+	size_t	slice, ntasks;
+
+	if ((num * es) < PARALLEL_ROTATE_MIN)
+		return CALL(ring_negative)(pa, po, pb, num, es);
+
+	if ((ntasks = parallel_slices(num, es, PARALLEL_ROTATE_MIN, &slice)) < 2)
+		return CALL(ring_negative)(pa, po, pb, num, es);
+
+	struct NAME(exchange_job) job = {pa, po, pb, num, slice, es};
+
+	parallel_for(ntasks, CALL(ring_negative_task), &job);
+} // ring_negative_mt
+
+
 // The heart of it all
 static void
 NAME(rotate_block)(VAR *pa, VAR *pb, VAR *pe, size_t es)
@@ -361,13 +460,13 @@ NAME(rotate_block)(VAR *pa, VAR *pb, VAR *pe, size_t es)
 				return CALL(rotate_overlap)(pa, pb, pe, es);
 
 			for ( ; na > no; pa += (no * ES), na -= no)
-				CALL(ring_positive)(pa, pb, pe - (na * ES), no, es);
+				CALL(ring_positive_mt)(pa, pb, pe - (na * ES), no, es);
 
-			CALL(ring_positive)(pa, pb, pe - (na * ES), na, es);
+			CALL(ring_positive_mt)(pa, pb, pe - (na * ES), na, es);
 
 			pa = pb, pe = pb + (no * ES), pb = pb + (na * ES);
 		} else if (na == nb) {
-			return CALL(two_way_swap_block)(pa, pb, na, es);
+			return CALL(two_way_swap_block_mt)(pa, pb, na, es);
 		} else if (nb == 0) {
 			return;
 		} else {
@@ -380,9 +479,9 @@ NAME(rotate_block)(VAR *pa, VAR *pb, VAR *pe, size_t es)
 				return CALL(rotate_overlap)(pa, pb, pe, es);
 
 			for ( ; nb > no; pe -= (no * ES), nb -= no)
-				CALL(ring_negative)(pa + (nb * ES), pb, pe, no, es);
+				CALL(ring_negative_mt)(pa + (nb * ES), pb, pe, no, es);
 
-			CALL(ring_negative)(pa + (nb * ES), pb, pe, nb, es);
+			CALL(ring_negative_mt)(pa + (nb * ES), pb, pe, nb, es);
 
 			pe = pb, pa = pb - (no * ES), pb = pb - (nb * ES);
 		}
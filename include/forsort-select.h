@@ -0,0 +1,406 @@
+//                              FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)     Copyright (C) 2021-2025
+//
+// This is my implementation of what I believe to be an O(nlogn) time-complexity
+// O(logn) space-complexity, in-place and adaptive merge-sort style algorithm.
+//
+// Selection style algorithms.  These all do less work than a full sort does
+// by only putting as much of the array into order as the caller asks for
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+#define CONCAT(x, y) x ## _ ## y
+#define MAKE_STR(x, y) CONCAT(x,y)
+#define NAME(x) MAKE_STR(x, VAR)
+#define CALL(x) NAME(x)
+
+//-----------------------------------------------------------------
+//                         SWAP macros
+//-----------------------------------------------------------------
+
+#ifdef UNTYPED
+
+#define	SWAP(_xa_, _xb_)	memswap((_xa_), (_xb_), ES)
+
+#else
+
+#define	SWAP(_xa_, _xb_)			\
+	{					\
+		VAR xa = *(VAR *)(_xa_);	\
+		VAR xb = *(VAR *)(_xb_);	\
+		*(VAR *)(_xb_) = xa;		\
+		*(VAR *)(_xa_) = xb;		\
+	}
+
+#endif
+
+#ifdef UNTYPED
+#define	COPY(_xd_, _xs_)	memcpy((_xd_), (_xs_), ES)
+#else
+#define	COPY(_xd_, _xs_)	(*(VAR *)(_xd_) = *(VAR *)(_xs_))
+#endif
+
+//-----------------------------------------------------------------
+//               Start of partial_sort() implementation
+//-----------------------------------------------------------------
+
+// Sorts PA->PA+N using whatever work-space we were given
+static void
+NAME(sort_with_workspace)(VAR *pa, const size_t n, VAR *ws, const size_t nw, COMMON_PARAMS)
+{
+	// Without a work-space, only stable_sort() can keep us sort-stable
+	if (ws && (nw > 0))
+		CALL(merge_sort_in_place)(pa, n, ws, nw, COMMON_ARGS);
+	else
+		CALL(stable_sort)(pa, n, COMMON_ARGS);
+} // sort_with_workspace
+
+
+// Sorts the candidates in PK->PC, and merges them in with the sorted PA->PK
+static void
+NAME(partial_merge)(VAR *pa, VAR *pk, VAR *pc, VAR *ws, const size_t nw, COMMON_PARAMS)
+{
+	size_t	nc = NITEM(pc - pk);
+
+	CALL(sort_with_workspace)(pk, nc, ws, nw, COMMON_ARGS);
+
+	if (ws && (nw > 0))
+		CALL(merge_workspace_constrained)(pa, NITEM(pk - pa), pk, nc, ws, nw, COMMON_ARGS);
+	else
+		CALL(rotate_merge_in_place)(pa, pk, pc, COMMON_ARGS);
+} // partial_merge
+
+
+// Sorts the smallest K items of PA->PA+N into PA->PA+K, in a sort-stable
+// manner, and leaves the rest of the array in no particular order.
+//
+// The first K items are sorted, and then the rest of the array is scanned for
+// items that are less than the current K'th item.  These candidates are moved
+// down to sit directly after the first K items in the order that they're found
+// and when K of them have been gathered up, they're sorted and merged in.  The
+// K'th item can only ever get smaller, and anything that falls out past it can
+// never make it back in again, so everything beyond PA+K is just scratch space.
+// Each merge is O(K), but only happens once K candidates have been found, and
+// so the overall cost stays at O(n log k)
+static void
+NAME(partial_sort)(VAR *pa, const size_t n, const size_t k, VAR *ws,
+		   const size_t nw, COMMON_PARAMS)
+{
+	if ((k == 0) || (n < 2))
+		return;
+
+	if (k >= n)
+		return CALL(sort_with_workspace)(pa, n, ws, nw, COMMON_ARGS);
+
+	VAR	*pk = pa + (k * ES), *pe = pa + (n * ES);
+	VAR	*pl = pk - ES;		// The K'th item
+	VAR	*pc = pk;		// The end of the candidates
+
+	CALL(sort_with_workspace)(pa, k, ws, nw, COMMON_ARGS);
+
+	for (VAR *pt = pk; pt < pe; pt += ES) {
+		// Items equal to the K'th item came after it, so they stay out
+		if (!IS_LT(pt, pl))
+			continue;
+
+		if (pt != pc)
+			SWAP(pc, pt);
+		pc += ES;
+
+		if ((pc - pk) == (pk - pa)) {
+			CALL(partial_merge)(pa, pk, pc, ws, nw, COMMON_ARGS);
+			pc = pk;
+		}
+	}
+
+	if (pc > pk)
+		CALL(partial_merge)(pa, pk, pc, ws, nw, COMMON_ARGS);
+} // partial_sort
+
+
+//-----------------------------------------------------------------
+//                Start of select_kth() implementation
+//-----------------------------------------------------------------
+
+static VAR *
+NAME(median_of_three)(VAR *p1, VAR *p2, VAR *p3, COMMON_PARAMS)
+{
+	if (IS_LT(p2, p1)) {
+		VAR	*pt = p1;
+		p1 = p2;
+		p2 = pt;
+	}
+
+	// P1 <= P2 now, so if P3 < P2, the median is the larger of P1 and P3
+	if (IS_LT(p3, p2))
+		return IS_LT(p3, p1) ? p1 : p3;
+	return p2;
+} // median_of_three
+
+
+// Returns a pointer to a good pivot choice within PA->PA+N
+static VAR *
+NAME(select_pivot)(VAR *pa, const size_t n, COMMON_PARAMS)
+{
+	VAR	*pm = pa + ((n >> 1) * ES), *pl = pa + ((n - 1) * ES);
+
+	if (n < 128)
+		return CALL(median_of_three)(pa, pm, pl, COMMON_ARGS);
+
+	// Use Tukey's ninther on larger arrays
+	size_t	step = (n >> 3) * ES;
+
+	VAR	*p1 = CALL(median_of_three)(pa, pa + step, pa + step + step, COMMON_ARGS);
+	VAR	*p2 = CALL(median_of_three)(pm - step, pm, pm + step, COMMON_ARGS);
+	VAR	*p3 = CALL(median_of_three)(pl - step - step, pl - step, pl, COMMON_ARGS);
+
+	return CALL(median_of_three)(p1, p2, p3, COMMON_ARGS);
+} // select_pivot
+
+
+// Hoare style partitioning of PA->PA+N around the pivot at PA.  Returns where
+// the pivot ends up.  Everything before it is <= to it, and everything after
+// it is >= to it.  Stopping on items equal to the pivot swaps them evenly out
+// to both sides, so that runs of duplicates still split down the middle
+static size_t
+NAME(select_partition)(VAR *pa, const size_t n, COMMON_PARAMS)
+{
+	VAR	*pl = pa + ES, *pr = pa + ((n - 1) * ES);
+
+	for (;;) {
+		while ((pl <= pr) && IS_LT(pl, pa))
+			pl += ES;
+		while ((pl <= pr) && IS_LT(pa, pr))
+			pr -= ES;
+		if (pl >= pr)
+			break;
+		SWAP(pl, pr);
+		pl += ES;
+		pr -= ES;
+	}
+
+	if (pr != pa)
+		SWAP(pa, pr);
+	return NITEM(pr - pa);
+} // select_partition
+
+
+// Moves the item that belongs at position K into place, with everything that
+// is <= to it before it, and everything that is >= to it after it.  This is
+// a quickselect, that falls back to sorting what remains if the partitioning
+// is going badly, and so is O(n) on average and O(nlogn) in the worst case
+static void
+NAME(select_kth)(VAR *pa, size_t n, size_t k, COMMON_PARAMS)
+{
+	size_t	limit = msb64(n) << 1;
+
+	while (n > BASIC_INSERT_MAX) {
+		if (limit-- == 0)
+			return CALL(merge_sort_in_place)(pa, n, NULL, 0, COMMON_ARGS);
+
+		VAR	*pp = CALL(select_pivot)(pa, n, COMMON_ARGS);
+
+		if (pp != pa)
+			SWAP(pa, pp);
+
+		size_t	pos = CALL(select_partition)(pa, n, COMMON_ARGS);
+
+		if (k == pos)
+			return;
+
+		if (k < pos) {
+			n = pos;
+		} else {
+			pos++;
+			pa += (pos * ES);
+			n -= pos;
+			k -= pos;
+		}
+	}
+	CALL(insertion_sort)(pa, n, COMMON_ARGS);
+} // select_kth
+
+
+//-----------------------------------------------------------------
+//                Start of stable_select() implementation
+//-----------------------------------------------------------------
+
+// Moves all the items in PA->PA+N that TEST(item, ARG) is true for over to the
+// left, and returns how many there were.  Both sides keep the relative order
+// that their items had before.  Ranges that fit into the work-space take one
+// linear pass, with the right side being copied out to the work-space and back
+// again.  Anything larger is split in two, each half is partitioned, and then
+// the right side of the first half is rotated with the left side of the second
+static size_t
+NAME(stable_partition)(VAR *pa, const size_t n, int (*test)(const void *, const void *),
+		       const void *arg, VAR *ws, const size_t nw, const size_t es)
+{
+	if (n == 0)
+		return 0;
+
+	if (n <= nw) {
+		VAR	*pe = pa + (n * ES), *pl = pa, *pw = ws;
+
+		for (VAR *pt = pa; pt < pe; pt += ES) {
+			if (test(pt, arg)) {
+				if (pl != pt)
+					COPY(pl, pt);
+				pl += ES;
+			} else {
+				COPY(pw, pt);
+				pw += ES;
+			}
+		}
+		memcpy(pl, ws, (pw - ws) * sizeof(VAR));
+		return NITEM(pl - pa);
+	}
+
+	if (n == 1)
+		return !!test(pa, arg);
+
+	size_t	na = n >> 1;
+	VAR	*pm = pa + (na * ES);
+	size_t	nl = CALL(stable_partition)(pa, na, test, arg, ws, nw, es);
+	size_t	nr = CALL(stable_partition)(pm, n - na, test, arg, ws, nw, es);
+
+	if ((nl < na) && (nr > 0))
+		CALL(rotate_block)(pa + (nl * ES), pm, pm + (nr * ES), es);
+
+	return nl + nr;
+} // stable_partition
+
+
+struct NAME(pivot_test) {
+	const VAR	*pv;
+	int		(*is_lt)(const void *, const void *);
+};
+
+static int
+NAME(test_less)(const void *item, const void *arg)
+{
+	const struct NAME(pivot_test) *pt = arg;
+
+	return pt->is_lt(item, pt->pv);
+} // test_less
+
+
+static int
+NAME(test_not_greater)(const void *item, const void *arg)
+{
+	const struct NAME(pivot_test) *pt = arg;
+
+	return !pt->is_lt(pt->pv, item);
+} // test_not_greater
+
+
+// A sort-stable version of select_kth().  The item that ends up at position K
+// is the very same item that a stable sort would have put there, and all the
+// items before it (and after it) would have also been before it (and after it)
+// in a stable sort.  Each round does a three-way stable partition of the range
+// around a copy of the pivot, into those that are less than, equal to, and
+// greater than it.  The items equal to the pivot are still in their original
+// order, so if K lands amongst them then we're done.  Only O(n) comparisons
+// are needed on average, but without a work-space the partitioning rotations
+// make this O(nlogn) in item moves.  A work-space of B items brings that down
+// to O(n log(n/B))
+static void
+NAME(stable_select)(VAR *pa, size_t n, size_t k, VAR *ws, const size_t nw, COMMON_PARAMS)
+{
+	size_t	limit = msb64(n) << 1;
+	VAR	pv[ES];		// Holds a copy of the pivot item
+
+	struct NAME(pivot_test) test = {pv, is_lt};
+
+	while (n > BASIC_INSERT_MAX) {
+		if (limit-- == 0)
+			return CALL(sort_with_workspace)(pa, n, ws, nw, COMMON_ARGS);
+
+		COPY(pv, CALL(select_pivot)(pa, n, COMMON_ARGS));
+
+		size_t	nl = CALL(stable_partition)(pa, n, CALL(test_less), &test, ws, nw, es);
+		size_t	ne = CALL(stable_partition)(pa + (nl * ES), n - nl,
+						    CALL(test_not_greater), &test, ws, nw, es);
+
+		if (k < nl) {
+			n = nl;
+		} else if (k < (nl + ne)) {
+			return;
+		} else {
+			pa += ((nl + ne) * ES);
+			n -= (nl + ne);
+			k -= (nl + ne);
+		}
+	}
+	if (n > 1)
+		CALL(insertion_sort)(pa, n, COMMON_ARGS);
+} // stable_select
+
+
+//-----------------------------------------------------------------
+//                Start of bucket_sort() implementation
+//-----------------------------------------------------------------
+
+// A sort-stable sort for inputs with only a few distinct keys.  Each round
+// does the same three-way stable partition that stable_select() does, and
+// then the items equal to the pivot are done.  Only the smaller of the two
+// remaining sides is recursed into, so the stack stays O(logn) deep.  With K
+// distinct keys, each item only takes part in about 2*log2(K) partitions, no
+// matter how many items there are.  Each of those is a stable_partition() with
+// just the 4KB stack buffer though, which costs O(n*log(n/B)) moves for a
+// buffer of B items, so it's O(n*log(K)*log(n/B)) moves in all.  Too many
+// rounds means that we were wrong about there only being a few keys, and so
+// we fall back to basic_sort()
+static void
+NAME(bucket_sort)(VAR *pa, size_t n, size_t limit, COMMON_PARAMS)
+{
+	_Alignas(64) char ws[BASIC_BUF_SIZE];
+	size_t	nw = BASIC_BUF_SIZE / es;
+	VAR	pv[ES];		// Holds a copy of the pivot item
+
+	struct NAME(pivot_test) test = {pv, is_lt};
+
+	while (n > BASIC_INSERT_MAX) {
+		if (limit-- == 0) {
+			CALL(basic_sort)(pa, n, COMMON_ARGS);
+			return;
+		}
+
+		COPY(pv, CALL(select_pivot)(pa, n, COMMON_ARGS));
+
+		size_t	nl = CALL(stable_partition)(pa, n, CALL(test_less), &test,
+						    (VAR *)ws, nw, es);
+		VAR	*pg = pa + (nl * ES);
+		size_t	ne = CALL(stable_partition)(pg, n - nl, CALL(test_not_greater),
+						    &test, (VAR *)ws, nw, es);
+		size_t	ng = n - nl - ne;
+
+		pg += (ne * ES);
+		if (nl < ng) {
+			if (nl > 1)
+				CALL(bucket_sort)(pa, nl, limit, COMMON_ARGS);
+			pa = pg;
+			n = ng;
+		} else {
+			if (ng > 1)
+				CALL(bucket_sort)(pg, ng, limit, COMMON_ARGS);
+			n = nl;
+		}
+	}
+	if (n > 1)
+		CALL(insertion_sort)(pa, n, COMMON_ARGS);
+} // bucket_sort
+
+
+//-----------------------------------------------------------------
+//                        #define cleanup
+//-----------------------------------------------------------------
+
+#undef COPY
+#undef SWAP
+#undef CONCAT
+#undef MAKE_STR
+#undef NAME
+#undef CALL
+#pragma GCC diagnostic pop
@@ -46,6 +46,9 @@
 // Uncomment to turn on debugging output for the uniques extraction and merging system
 // #define       DEBUG_UNIQUE_PROCESSING
 
+// Implemented in forsort-select.h
+static void NAME(bucket_sort)(VAR *pa, size_t n, size_t limit, COMMON_PARAMS);
+
 // A structure to manage the state of the stable sort algorithm
 struct NAME(stable_state) {
 	// All sizes are in numbers of entries, not bytes
@@ -369,6 +372,10 @@ NAME(stable_sort)(VAR * const pa, const size_t n, COMMON_PARAMS)
 	if (n < 75)
 		return (void)(CALL(basic_sort)(pa, n, COMMON_ARGS));
 
+	// Let multiple threads check if a large input is already in order
+	if (CALL(parallel_presorted)(pa, n, COMMON_ARGS))
+		return;
+
 	// We start with a workspace candidate size that is intentionally
 	// small, as we need to use the slower basic_sort() algorithm to
 	// kick start the process.  The idea here is to then use the
@@ -430,6 +437,12 @@ NAME(stable_sort)(VAR * const pa, const size_t n, COMMON_PARAMS)
 	// Recalculate size of work_space after duplicates were extracted
 	nw = NITEM(pr - ws);
 
+	// Finding only a few distinct keys amongst lots of duplicates hints that
+	// there's only a few distinct keys overall.  Such inputs would just end
+	// up in basic_sort() after a long hunt for uniques, so bucket them now
+	if ((nw <= STABLE_LOW_CARDINALITY) && ((nw << 3) < NITEM(pr - pa)))
+		return CALL(bucket_sort)(pa, n, (msb64(nw) + 2) << 2, COMMON_ARGS);
+
 	// Initialise state structure
 	state->work_space = ws;
 	state->work_size = nw;
@@ -504,8 +517,12 @@ NAME(stable_sort)(VAR * const pa, const size_t n, COMMON_PARAMS)
 		state->rest_size = nr;
 
 		// Determine how much work-space to use for sorting.  Doing so
-		// means we need to sort less of it afterwards, and saves time
+		// means we need to sort less of it afterwards, and saves time.
+		// We must always use at least 1 item though, as without any
+		// work-space, merge_sort_in_place() is no longer sort-stable
 		size_t tnw = grab / STABLE_WSRATIO;
+		if (tnw == 0)
+			tnw = 1;
 
 		// Sort new work-space candidates using our current workspace
 		CALL(merge_sort_in_place)(nws, grab, ws, tnw, COMMON_ARGS);
@@ -571,6 +588,52 @@ NAME(stable_sort)(VAR * const pa, const size_t n, COMMON_PARAMS)
 	CALL(stable_sort_finisher)(state, COMMON_ARGS);
 } // stable_sort
 
+
+// Moves the first item of each run of equal items within the sorted PA->PA+N
+// down to the front, keeping them in order, and returns how many there were.
+// If COMBINE is given, then every other item of a run is folded into the first
+// one, in order, as they are passed over.  Only items from the first duplicate
+// onwards are ever moved, and each only once.  Anything beyond the returned
+// count is left in no particular order.  Unlike extract_uniques(), which keeps
+// the last item of each run, we keep the first, and don't care about what
+// order the duplicates are left in, so a single pass of swaps is all we need
+static size_t
+NAME(unique_sorted)(VAR * const pa, const size_t n,
+		    void (*combine)(void *, const void *), COMMON_PARAMS)
+{
+	if (n == 0)
+		return 0;
+
+	VAR	*pe = pa + (n * ES), *pu = pa;	// PU is the last unique item
+
+	for (VAR *pt = pa + ES; pt < pe; pt += ES) {
+		if (IS_LT(pu, pt)) {
+			pu += ES;
+			if (pu != pt)
+				SWAP(pu, pt);
+		} else if (combine) {
+			combine(pu, pt);
+		}
+	}
+
+	return NITEM(pu - pa) + 1;
+} // unique_sorted
+
+
+// Sorts PA->PA+N in a sort-stable manner, using the work-space if we have one,
+// and then collects the first item of every run of equal items at the front
+static size_t
+NAME(sort_unique)(VAR * const pa, const size_t n, VAR * const ws, const size_t nw,
+		  void (*combine)(void *, const void *), COMMON_PARAMS)
+{
+	if (ws && (nw > 0))
+		CALL(merge_sort_in_place)(pa, n, ws, nw, COMMON_ARGS);
+	else
+		CALL(stable_sort)(pa, n, COMMON_ARGS);
+
+	return CALL(unique_sorted)(pa, n, combine, COMMON_ARGS);
+} // sort_unique
+
 //-----------------------------------------------------------------
 //                      #DEF  cleanup!
 //-----------------------------------------------------------------
@@ -0,0 +1,525 @@
+//                              FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)     Copyright (C) 2021-2025
+//
+// Generic (untyped) threading helpers.  ForSort is fundamentally a single
+// threaded algorithm, but a few of its building blocks, such as the block
+// exchanges within rotate_block(), are trivially divisible into independent
+// slices.  For very large inputs it is worth farming those out to multiple
+// threads, as a single core cannot drive all of the available memory bandwidth
+//
+// This file is included exactly once by forsort.c, ahead of all the typed
+// includes, as nothing in here cares about the type being sorted.
+
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include "forsort-huge.h"
+
+#ifdef HAVE_LIBNUMA
+#include <numa.h>
+#include <numaif.h>
+#endif
+
+#ifndef MPOL_MF_MOVE
+#define MPOL_MF_MOVE	(1 << 1)
+#endif
+
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-function"
+
+// Set whilst a thread is executing a parallel task.  Any nested requests to
+// go parallel from within a task will just run serially on that same thread,
+// which stops us from ever over-subscribing the CPUs with threads
+static _Thread_local bool in_parallel_task = false;
+
+// A pool of long-lived worker threads, owned by a sort context.  Whilst a pool
+// is active on the calling thread, parallel_for() hands its tasks out to the
+// pool's workers rather than creating and joining a new thread for each one
+struct parallel_pool {
+	pthread_mutex_t	lock;
+	pthread_cond_t	wake;			// Signalled when there's new work
+	pthread_cond_t	done;			// Signalled when all work is done
+	size_t		nthreads;		// Most threads to use, incl. caller
+	size_t		nworkers;		// Worker threads started so far
+	pthread_t	tids[MAX_THREADS];
+	void		(*fn)(void *, size_t);	// The current batch of tasks
+	void		*arg;
+	size_t		ntasks;			// No. of tasks in the batch
+	size_t		next;			// Next task to be handed out
+	size_t		pending;		// Tasks yet to be completed
+	bool		shutdown;
+};
+
+// The pool that parallel_for() uses on this thread, or NULL if there isn't one
+static _Thread_local struct parallel_pool *active_pool = NULL;
+
+// Returns the number of threads we're able to use right now
+static size_t
+parallel_threads(void)
+{
+	static size_t	ncpus = 0;
+	size_t		nt = __atomic_load_n(&ncpus, __ATOMIC_RELAXED);
+
+	if (in_parallel_task)
+		return 1;
+
+	if (active_pool)
+		return active_pool->nthreads;
+
+	if (nt == 0) {
+		long	n = sysconf(_SC_NPROCESSORS_ONLN);
+
+		nt = (n < 1) ? 1 : (n > MAX_THREADS) ? MAX_THREADS : (size_t)n;
+		__atomic_store_n(&ncpus, nt, __ATOMIC_RELAXED);
+	}
+	return nt;
+} // parallel_threads
+
+
+// Works out how to split NUM items of ES bytes each into per-thread slices.
+// Returns the number of slices, and the number of items per slice in SLICE.
+// A return value of 1 means that the caller should just do the work itself
+static size_t
+parallel_slices(size_t num, size_t es, size_t min_bytes, size_t *slice)
+{
+	size_t	bytes = num * es, nt;
+
+	if ((min_bytes == 0) || (bytes < min_bytes))
+		return 1;
+
+	if ((nt = parallel_threads()) < 2)
+		return 1;
+
+	if (nt > (bytes / PARALLEL_SLICE_MIN))
+		nt = bytes / PARALLEL_SLICE_MIN;
+
+	if (nt < 2)
+		return 1;
+
+	// Keep slices a multiple of 64 items so that every slice other than
+	// the last one starts on the same alignment as the first one does
+	*slice = (((num + nt - 1) / nt) + 63) & ~(size_t)63;
+
+	return (num + *slice - 1) / *slice;
+} // parallel_slices
+
+
+struct parallel_task {
+	void	(*fn)(void *, size_t);
+	void	*arg;
+	size_t	index;
+};
+
+static void *
+parallel_task_start(void *p)
+{
+	struct parallel_task *task = p;
+
+	in_parallel_task = true;
+	task->fn(task->arg, task->index);
+	return NULL;
+} // parallel_task_start
+
+
+// Runs tasks from the pool's current batch until there are none left to hand
+// out.  Must be called with the pool lock held, which is dropped whilst each
+// task is actually running
+static void
+pool_run_tasks(struct parallel_pool *pool)
+{
+	while (pool->next < pool->ntasks) {
+		void	(*fn)(void *, size_t) = pool->fn;
+		void	*arg = pool->arg;
+		size_t	index = pool->next++;
+
+		pthread_mutex_unlock(&pool->lock);
+		fn(arg, index);
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->pending == 0)
+			pthread_cond_signal(&pool->done);
+	}
+} // pool_run_tasks
+
+
+static void *
+pool_worker(void *p)
+{
+	struct parallel_pool *pool = p;
+
+	in_parallel_task = true;
+
+	pthread_mutex_lock(&pool->lock);
+	while (!pool->shutdown) {
+		pool_run_tasks(pool);
+		if (!pool->shutdown)
+			pthread_cond_wait(&pool->wake, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+	return NULL;
+} // pool_worker
+
+
+// Workers are only started up as they're first needed, so a pool that never
+// gets handed any large sorts never costs anything more than its memory
+static bool
+pool_init(struct parallel_pool *pool, size_t nthreads)
+{
+	memset(pool, 0, sizeof(*pool));
+	pool->nthreads = nthreads;
+
+	if (pthread_mutex_init(&pool->lock, NULL) != 0)
+		return false;
+
+	if (pthread_cond_init(&pool->wake, NULL) != 0) {
+		pthread_mutex_destroy(&pool->lock);
+		return false;
+	}
+
+	if (pthread_cond_init(&pool->done, NULL) != 0) {
+		pthread_cond_destroy(&pool->wake);
+		pthread_mutex_destroy(&pool->lock);
+		return false;
+	}
+	return true;
+} // pool_init
+
+
+static void
+pool_destroy(struct parallel_pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	pool->shutdown = true;
+	pthread_cond_broadcast(&pool->wake);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (size_t i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->tids[i], NULL);
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->wake);
+	pthread_mutex_destroy(&pool->lock);
+} // pool_destroy
+
+
+// The parallel_for() implementation for when a pool is active.  Tasks are
+// handed out one at a time to whichever thread asks next, the caller included,
+// so it all still works out even if we couldn't start up as many workers as
+// we wanted to.  A pool can only be used by one calling thread at a time
+static void
+pool_parallel_for(struct parallel_pool *pool, size_t ntasks,
+		  void (*fn)(void *, size_t), void *arg)
+{
+	pthread_mutex_lock(&pool->lock);
+
+	while (((pool->nworkers + 1) < ntasks) && (pool->nworkers < (MAX_THREADS - 1))) {
+		if (pthread_create(pool->tids + pool->nworkers, NULL, pool_worker, pool) != 0)
+			break;
+		pool->nworkers++;
+	}
+
+	pool->fn = fn;
+	pool->arg = arg;
+	pool->ntasks = ntasks;
+	pool->next = 0;
+	pool->pending = ntasks;
+	pthread_cond_broadcast(&pool->wake);
+
+	in_parallel_task = true;
+	pool_run_tasks(pool);
+	while (pool->pending > 0)
+		pthread_cond_wait(&pool->done, &pool->lock);
+	in_parallel_task = false;
+
+	pthread_mutex_unlock(&pool->lock);
+} // pool_parallel_for
+
+
+// Runs fn(arg, 0) ... fn(arg, ntasks - 1) concurrently, and only returns
+// when all of them have completed.  The calling thread runs task 0 itself.
+// If a thread cannot be created, then its task is simply run inline
+static void
+parallel_for(size_t ntasks, void (*fn)(void *, size_t), void *arg)
+{
+	struct parallel_task	tasks[MAX_THREADS];
+	pthread_t		tids[MAX_THREADS];
+	bool			started[MAX_THREADS];
+	bool			nested = in_parallel_task;
+
+	ASSERT(ntasks <= MAX_THREADS);
+
+	if ((ntasks < 2) || nested) {
+		for (size_t i = 0; i < ntasks; i++)
+			fn(arg, i);
+		return;
+	}
+
+	if (active_pool)
+		return pool_parallel_for(active_pool, ntasks, fn, arg);
+
+	in_parallel_task = true;
+
+	for (size_t i = 1; i < ntasks; i++) {
+		tasks[i].fn = fn;
+		tasks[i].arg = arg;
+		tasks[i].index = i;
+		started[i] = (pthread_create(tids + i, NULL, parallel_task_start, tasks + i) == 0);
+		if (!started[i])
+			fn(arg, i);
+	}
+
+	fn(arg, 0);
+
+	for (size_t i = 1; i < ntasks; i++)
+		if (started[i])
+			pthread_join(tids[i], NULL);
+
+	in_parallel_task = nested;
+} // parallel_for
+
+
+//-----------------------------------------------------------------
+//                     NUMA topology handling
+//-----------------------------------------------------------------
+
+// On multi-socket machines each node has its own memory, and reaching across
+// to another node's memory is both slower and eats into the bandwidth of the
+// interconnect.  We only need to know how many nodes there are, and which CPUs
+// belong to each of them.  libnuma is used to find this out if we were built
+// with it, otherwise we read the same information directly from /sys
+struct numa_topology {
+	size_t		nnodes;				// Nodes with CPUs
+	size_t		total_cpus;			// Sum of all ncpus[]
+	int		node_id[MAX_NUMA_NODES];	// Kernel's node number
+	size_t		ncpus[MAX_NUMA_NODES];		// CPUs in each node
+	cpu_set_t	cpus[MAX_NUMA_NODES];		// Which CPUs they are
+};
+
+static struct numa_topology	node_topo;
+static pthread_once_t		node_topo_once = PTHREAD_ONCE_INIT;
+
+// Parses a kernel ID list such as "0-15,32-47" into a cpu_set_t
+static size_t
+node_parse_list(const char *s, cpu_set_t *set)
+{
+	size_t	count = 0;
+
+	CPU_ZERO(set);
+	while (*s) {
+		char	*end;
+		long	lo = strtol(s, &end, 10), hi = lo;
+
+		if (end == s)
+			break;
+		if (*end == '-')
+			hi = strtol(end + 1, &end, 10);
+		for ( ; (lo <= hi) && (lo < CPU_SETSIZE); lo++, count++)
+			CPU_SET(lo, set);
+		s = (*end == ',') ? end + 1 : end;
+	}
+	return count;
+} // node_parse_list
+
+
+static void
+node_add_topology(int node, cpu_set_t *set, size_t ncpus)
+{
+	struct numa_topology *topo = &node_topo;
+
+	if ((ncpus == 0) || (topo->nnodes >= MAX_NUMA_NODES))
+		return;
+
+	topo->node_id[topo->nnodes] = node;
+	topo->ncpus[topo->nnodes] = ncpus;
+	topo->cpus[topo->nnodes] = *set;
+	topo->total_cpus += ncpus;
+	topo->nnodes++;
+} // node_add_topology
+
+
+#ifdef HAVE_LIBNUMA
+static void
+node_topology_init(void)
+{
+	if (numa_available() < 0)
+		return;
+
+	struct bitmask	*mask = numa_allocate_cpumask();
+
+	for (int node = 0; node <= numa_max_node(); node++) {
+		cpu_set_t	set;
+		size_t		ncpus = 0;
+
+		if (numa_node_to_cpus(node, mask) < 0)
+			continue;
+
+		CPU_ZERO(&set);
+		for (unsigned int cpu = 0; (cpu < mask->size) && (cpu < CPU_SETSIZE); cpu++) {
+			if (numa_bitmask_isbitset(mask, cpu)) {
+				CPU_SET(cpu, &set);
+				ncpus++;
+			}
+		}
+		node_add_topology(node, &set, ncpus);
+	}
+	numa_free_cpumask(mask);
+} // node_topology_init
+#else
+static void
+node_topology_init(void)
+{
+	char		buf[4096], path[96];
+	cpu_set_t	nodes;
+	FILE		*fp;
+
+	if ((fp = fopen("/sys/devices/system/node/online", "r")) == NULL)
+		return;
+	buf[0] = '\0';
+	if (fgets(buf, sizeof(buf), fp) == NULL)
+		buf[0] = '\0';
+	fclose(fp);
+
+	// Node numbers use the same list format as CPU numbers do
+	node_parse_list(buf, &nodes);
+
+	for (int node = 0; node < CPU_SETSIZE; node++) {
+		cpu_set_t	set;
+		size_t		ncpus;
+
+		if (!CPU_ISSET(node, &nodes))
+			continue;
+
+		snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+		if ((fp = fopen(path, "r")) == NULL)
+			continue;
+		if (fgets(buf, sizeof(buf), fp) != NULL) {
+			ncpus = node_parse_list(buf, &set);
+			node_add_topology(node, &set, ncpus);
+		}
+		fclose(fp);
+	}
+} // node_topology_init
+#endif
+
+
+// Returns the NUMA topology, or NULL if this isn't a multi-node machine
+static const struct numa_topology *
+node_get_topology(void)
+{
+	pthread_once(&node_topo_once, node_topology_init);
+
+	return (node_topo.nnodes > 1) ? &node_topo : NULL;
+} // node_get_topology
+
+
+// Restricts the calling thread to only run on the CPUs of the given node.
+// Tasks run on the caller's own thread as well as on pool workers, so the
+// thread's previous CPU mask is saved into PREV, and node_unpin_thread() must
+// be called with it once the task is done.  Returns false if the thread was
+// left as it was, in which case there's nothing to restore
+static bool
+node_pin_thread(const struct numa_topology *topo, size_t node, cpu_set_t *prev)
+{
+	pthread_t	self = pthread_self();
+
+	if (pthread_getaffinity_np(self, sizeof(*prev), prev) != 0)
+		return false;
+
+	return (pthread_setaffinity_np(self, sizeof(cpu_set_t), &topo->cpus[node]) == 0);
+} // node_pin_thread
+
+
+// Puts back the CPU mask that node_pin_thread() saved
+static void
+node_unpin_thread(const cpu_set_t *prev)
+{
+	pthread_setaffinity_np(pthread_self(), sizeof(*prev), prev);
+} // node_unpin_thread
+
+
+// Asks the kernel to move all pages wholly within addr->addr+len over to
+// the given node.  Pages that are already resident on that node are left
+// alone.  This is purely a performance hint, so all errors are ignored
+static void
+node_migrate(const struct numa_topology *topo, void *addr, size_t len, size_t node)
+{
+	enum { BATCH = 1024 };
+
+	uintptr_t	pgsz = (uintptr_t)sysconf(_SC_PAGESIZE);
+	uintptr_t	pos = ((uintptr_t)addr + pgsz - 1) & ~(pgsz - 1);
+	uintptr_t	end = ((uintptr_t)addr + len) & ~(pgsz - 1);
+	void		*pages[BATCH];
+	int		nodes[BATCH], status[BATCH];
+
+	while (pos < end) {
+		unsigned long	count;
+
+		for (count = 0; (count < BATCH) && (pos < end); count++, pos += pgsz) {
+			pages[count] = (void *)pos;
+			nodes[count] = topo->node_id[node];
+		}
+#ifdef HAVE_LIBNUMA
+		if (numa_move_pages(0, count, pages, nodes, status, MPOL_MF_MOVE) < 0)
+			return;
+#else
+		if (syscall(SYS_move_pages, 0, count, pages, nodes, status, MPOL_MF_MOVE) < 0)
+			return;
+#endif
+	}
+} // node_migrate
+
+
+// Allocations of HUGE_ALLOC_MIN bytes or more are mapped directly with
+// huge_map(), and so are backed by 2MB pages where the system allows it.
+// Anything smaller just comes from malloc()
+static void *
+huge_alloc(size_t size)
+{
+	if ((HUGE_ALLOC_MIN == 0) || (size < HUGE_ALLOC_MIN))
+		return malloc(size);
+
+	return huge_map(size, NULL);
+} // huge_alloc
+
+
+static void
+huge_free(void *p, size_t size)
+{
+	if (p == NULL)
+		return;
+
+	if ((HUGE_ALLOC_MIN == 0) || (size < HUGE_ALLOC_MIN))
+		return free(p);
+
+	huge_unmap(p, size);
+} // huge_free
+
+
+// Allocates memory for use by a thread that is pinned to the given node.
+// Without libnuma we rely upon the kernel's default first-touch policy to
+// place the pages on the node of the (pinned) thread that first writes them
+static void *
+node_alloc_local(const struct numa_topology *topo, size_t size, size_t node)
+{
+#ifdef HAVE_LIBNUMA
+	if (topo != NULL)
+		return numa_alloc_onnode(size, topo->node_id[node]);
+#endif
+	return huge_alloc(size);
+} // node_alloc_local
+
+
+static void
+node_free_local(const struct numa_topology *topo, void *p, size_t size)
+{
+#ifdef HAVE_LIBNUMA
+	if (topo != NULL)
+		return numa_free(p, size);
+#endif
+	huge_free(p, size);
+} // node_free_local
+
+#pragma GCC diagnostic pop
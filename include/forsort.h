@@ -16,4 +16,104 @@ void forsort_stable(void *a, const size_t n, const size_t es,
 void forsort_inplace(void *a, const size_t n, const size_t es,
 	int (*is_lt)(const void *, const void *),
 	void *workspace, size_t worksize);
+
+
+void forsort_parallel(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *), size_t nthreads);
+
+
+size_t forsort_runs(const void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	size_t *offsets, size_t noffsets);
+
+
+void forsort_batch(void * const *arrays, const size_t *counts, const size_t k,
+	const size_t es, int (*is_lt)(const void *, const void *));
+
+
+void forsort_partial(void *a, const size_t n, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize);
+
+
+void forsort_merge(void *a, const size_t na, const size_t nb, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize);
+
+
+void forsort_kmerge(void *a, const size_t *offsets, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize);
+
+
+void forsort_append_sorted(void *a, const size_t n_sorted, const size_t n_new,
+	const size_t es, int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize);
+
+
+size_t forsort_unique(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *));
+
+
+size_t forsort_reduce(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void (*combine)(void *, const void *));
+
+
+size_t forsort_stable_partition(void *a, const size_t n, const size_t es,
+	int (*pred)(const void *),
+	void *workspace, size_t worksize);
+
+
+void forsort_prefix(void **a, const size_t n, uint64_t (*prefix)(const void *),
+	int (*is_lt)(const void *, const void *));
+
+
+void forsort_strings(char **a, const size_t n);
+
+
+int forsort_cosort(void *keys, const size_t n, const size_t key_es,
+	int (*is_lt)(const void *, const void *),
+	void * const *payloads, const size_t *payload_es, const size_t m);
+
+
+void forsort_select(void *a, const size_t n, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *));
+
+
+void forsort_select_stable(void *a, const size_t n, const size_t k,
+	const size_t es, int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize);
+
+
+// A sort context keeps its work-spaces and worker threads between calls.  A
+// context must only be used by one thread at a time.  All opts may be 0 to
+// get the defaults, and a NULL opts gets all of the defaults
+typedef struct forsort_ctx forsort_ctx_t;
+
+typedef struct forsort_opts {
+	size_t	nthreads;	// Most threads to use.  0 uses all CPUs
+	size_t	wsratio;	// Work-space is 1/wsratio of the array size
+	size_t	max_workspace;	// Upper limit on work-space size in bytes
+} forsort_opts_t;
+
+forsort_ctx_t *forsort_ctx_create(const forsort_opts_t *opts);
+
+void forsort_ctx_destroy(forsort_ctx_t *ctx);
+
+void forsort_basic_ctx(forsort_ctx_t *ctx, void *a, const size_t n,
+	const size_t es, int (*is_lt)(const void *, const void *));
+
+void forsort_stable_ctx(forsort_ctx_t *ctx, void *a, const size_t n,
+	const size_t es, int (*is_lt)(const void *, const void *));
+
+void forsort_inplace_ctx(forsort_ctx_t *ctx, void *a, const size_t n,
+	const size_t es, int (*is_lt)(const void *, const void *));
+
+void forsort_parallel_ctx(forsort_ctx_t *ctx, void *a, const size_t n,
+	const size_t es, int (*is_lt)(const void *, const void *));
+
+void forsort_batch_ctx(forsort_ctx_t *ctx, void * const *arrays,
+	const size_t *counts, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *));
 #endif
@@ -0,0 +1,965 @@
+//				FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)	Copyright (C) 2021-2025
+//
+// forsort-check - Runs every public API over a range of array sizes, key
+// ranges and item sizes, and checks each result against a reference
+//
+// Every item holds a 32-bit key, followed by a 32-bit tag with its index in
+// the generated set, followed by padding bytes that are derived from the tag.
+// The reference is the set sorted by (key, tag) with qsort(), which is just
+// what a stable sort gives.  Each result is checked to be sorted, to be
+// stable where the API promises that, and to be a permutation of the input.
+// A permutation check looks every item up by its tag, and compares all of its
+// bytes, so that items which have been torn apart are caught as well.
+//
+// Items of 8 and 16 bytes go down the 64 and 128 bit typed paths, while 12
+// byte items go down the untyped path.
+//
+// Exits with 0 if every check passed, or 1 otherwise
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include "forsort.h"
+#include "forsort-file.h"
+
+static	const size_t	check_es[] = {8, 12, 16};
+static	const size_t	check_n[] = {0, 1, 2, 5, 9, 24, 25, 100, 1000, 3000, 20000};
+
+// Key ranges.  0 means as many keys as there are items
+static	const size_t	check_keys[] = {0, 1000000, 1, 3};
+
+// A large set with only a few keys goes to bucket_sort(), which once recursed
+// into empty sides and then ran insertion_sort() on no items at all
+#define	FEW_KEYS_N	200000
+#define	FEW_KEYS	3
+#define	SMALL_FEW_KEYS_SETS	3000
+
+// The set being checked against, and the reference that it sorts into
+static	size_t	es, n, nkeys;
+static	char	*orig = NULL, *ref = NULL, *a = NULL, *ws = NULL;
+static	bool	*seen = NULL;
+static	size_t	failures = 0, checks = 0;
+
+static	forsort_ctx_t	*ctx = NULL, *ctx_opts = NULL;
+
+
+static inline uint32_t
+key_of(const void *p)
+{
+	uint32_t	k;
+
+	memcpy(&k, p, sizeof(k));
+	return k;
+} // key_of
+
+
+static inline uint32_t
+tag_of(const void *p)
+{
+	uint32_t	t;
+
+	memcpy(&t, (const char *)p + sizeof(uint32_t), sizeof(t));
+	return t;
+} // tag_of
+
+
+static inline char *
+item(char *base, size_t i)
+{
+	return base + (i * es);
+} // item
+
+
+static int
+is_lt(const void *p1, const void *p2)
+{
+	return key_of(p1) < key_of(p2);
+} // is_lt
+
+
+// Orders by (key, tag), which is the order that a stable sort gives
+static int
+cmp_key_tag(const void *p1, const void *p2)
+{
+	uint32_t	k1 = key_of(p1), k2 = key_of(p2);
+	uint32_t	t1 = tag_of(p1), t2 = tag_of(p2);
+
+	if (k1 != k2)
+		return (k1 < k2) ? -1 : 1;
+	return (t1 < t2) ? -1 : (t1 > t2);
+} // cmp_key_tag
+
+
+static void
+fail(const char *name, const char *what)
+{
+	failures++;
+	fprintf(stderr, "FAIL: %-24s es=%-2zu n=%-6zu keys=%-7zu %s\n", name, es, n, nkeys, what);
+} // fail
+
+
+// Generates the set, and sorts a copy of it into the reference
+static void
+generate(void)
+{
+	for (size_t i = 0; i < n; i++) {
+		uint32_t	k = random() % nkeys, t = i;
+		char		*p = item(orig, i);
+
+		memcpy(p, &k, sizeof(k));
+		memcpy(p + sizeof(k), &t, sizeof(t));
+		for (size_t j = 2 * sizeof(uint32_t); j < es; j++)
+			p[j] = (char)((t * 31) + j);
+	}
+
+	memcpy(ref, orig, n * es);
+	qsort(ref, n, es, cmp_key_tag);
+} // generate
+
+
+// Checks that the first NA items of A are sorted
+static bool
+check_sorted(const char *name, char *pa, size_t na)
+{
+	for (size_t i = 1; i < na; i++)
+		if (is_lt(item(pa, i), item(pa, i - 1))) {
+			fail(name, "not sorted");
+			return false;
+		}
+	return true;
+} // check_sorted
+
+
+// Checks that items with equal keys are still in their original order
+static bool
+check_stable(const char *name, char *pa, size_t na)
+{
+	for (size_t i = 1; i < na; i++)
+		if ((key_of(item(pa, i)) == key_of(item(pa, i - 1))) &&
+		    (tag_of(item(pa, i)) < tag_of(item(pa, i - 1)))) {
+			fail(name, "not stable");
+			return false;
+		}
+	return true;
+} // check_stable
+
+
+// Checks that A holds every item of the set exactly once, and unchanged
+static bool
+check_perm(const char *name, char *pa)
+{
+	memset(seen, 0, n * sizeof(*seen));
+	for (size_t i = 0; i < n; i++) {
+		uint32_t	t = tag_of(item(pa, i));
+
+		if ((t >= n) || seen[t] || memcmp(item(pa, i), item(orig, t), es)) {
+			fail(name, "not a permutation of the input");
+			return false;
+		}
+		seen[t] = true;
+	}
+	return true;
+} // check_perm
+
+
+static void
+check_sort(const char *name, bool stable)
+{
+	checks++;
+	if (check_perm(name, a) && check_sorted(name, a, n) && stable)
+		check_stable(name, a, n);
+} // check_sort
+
+
+// Checks that the result is exactly the reference
+static void
+check_ref(const char *name)
+{
+	checks++;
+	if (check_perm(name, a) && check_sorted(name, a, n) && check_stable(name, a, n))
+		if (memcmp(a, ref, n * es))
+			fail(name, "does not match the reference");
+} // check_ref
+
+
+static void
+check_sorts(void)
+{
+	size_t	nws = (n / 8) + 1;
+
+	memcpy(a, orig, n * es);
+	forsort_basic(a, n, es, is_lt);
+	check_ref("forsort_basic");
+
+	memcpy(a, orig, n * es);
+	forsort_stable(a, n, es, is_lt);
+	check_ref("forsort_stable");
+
+	memcpy(a, orig, n * es);
+	forsort_inplace(a, n, es, is_lt, NULL, 0);
+	check_sort("forsort_inplace", false);
+
+	memcpy(a, orig, n * es);
+	forsort_inplace(a, n, es, is_lt, NULL, 1);
+	check_ref("forsort_inplace dynamic");
+
+	memcpy(a, orig, n * es);
+	forsort_inplace(a, n, es, is_lt, ws, nws * es);
+	check_ref("forsort_inplace workspace");
+
+	memcpy(a, orig, n * es);
+	forsort_parallel(a, n, es, is_lt, 0);
+	check_ref("forsort_parallel");
+
+	memcpy(a, orig, n * es);
+	forsort_parallel(a, n, es, is_lt, 2);
+	check_ref("forsort_parallel 2");
+
+	memcpy(a, orig, n * es);
+	forsort_basic_ctx(ctx, a, n, es, is_lt);
+	check_ref("forsort_basic_ctx");
+
+	memcpy(a, orig, n * es);
+	forsort_stable_ctx(ctx, a, n, es, is_lt);
+	check_ref("forsort_stable_ctx");
+
+	memcpy(a, orig, n * es);
+	forsort_inplace_ctx(ctx, a, n, es, is_lt);
+	check_ref("forsort_inplace_ctx");
+
+	// A small work-space cap can leave short arrays with none at all, so
+	// the result is only sort-stable from there on up
+	memcpy(a, orig, n * es);
+	forsort_inplace_ctx(ctx_opts, a, n, es, is_lt);
+	check_sort("forsort_inplace_ctx opts", false);
+
+	memcpy(a, orig, n * es);
+	forsort_parallel_ctx(ctx, a, n, es, is_lt);
+	check_ref("forsort_parallel_ctx");
+
+	memcpy(a, orig, n * es);
+	forsort_parallel_ctx(ctx_opts, a, n, es, is_lt);
+	check_ref("forsort_parallel_ctx opts");
+} // check_sorts
+
+
+// Splits the set into arrays of assorted sizes, some of them empty
+static void
+check_batch(forsort_ctx_t *bctx, const char *name)
+{
+	void	*arrays[64];
+	size_t	counts[64], k = 0;
+
+	memcpy(a, orig, n * es);
+	for (size_t i = 0; (i < n) || (k == 0); k++) {
+		size_t	c = random() % ((n / 8) + 2);
+
+		if ((c > (n - i)) || (k == 63))
+			c = n - i;
+		arrays[k] = item(a, i);
+		counts[k] = c;
+		i += c;
+	}
+
+	if (bctx)
+		forsort_batch_ctx(bctx, arrays, counts, k, es, is_lt);
+	else
+		forsort_batch(arrays, counts, k, es, is_lt);
+
+	checks++;
+	if (!check_perm(name, a))
+		return;
+	for (size_t i = 0; i < k; i++)
+		if (!check_sorted(name, arrays[i], counts[i]) ||
+		    !check_stable(name, arrays[i], counts[i]))
+			return;
+} // check_batch
+
+
+// The first K items must be the first K items of the reference
+static void
+check_partial(void)
+{
+	size_t	ks[] = {0, 1, n / 3, n};
+
+	for (size_t i = 0; i < (sizeof(ks) / sizeof(*ks)); i++) {
+		size_t	k = ks[i];
+
+		if (k > n)
+			continue;
+
+		memcpy(a, orig, n * es);
+		forsort_partial(a, n, k, es, is_lt, NULL, 1);
+		checks++;
+		if (check_perm("forsort_partial dynamic", a) && memcmp(a, ref, k * es))
+			fail("forsort_partial dynamic", "first k items do not match the reference");
+
+		memcpy(a, orig, n * es);
+		forsort_partial(a, n, k, es, is_lt, NULL, 0);
+		checks++;
+		if (check_perm("forsort_partial", a) && memcmp(a, ref, k * es))
+			fail("forsort_partial", "first k items do not match the reference");
+	}
+} // check_partial
+
+
+static void
+check_select(void)
+{
+	size_t	ks[] = {0, n / 2, n - 1};
+
+	if (n == 0)
+		return;
+
+	for (size_t i = 0; i < (sizeof(ks) / sizeof(*ks)); i++) {
+		size_t	k = ks[i];
+		char	*pk = item(a, k);
+
+		memcpy(a, orig, n * es);
+		forsort_select(a, n, k, es, is_lt);
+		checks++;
+		if (check_perm("forsort_select", a)) {
+			if (key_of(pk) != key_of(item(ref, k)))
+				fail("forsort_select", "wrong item at k");
+			for (size_t j = 0; j < n; j++)
+				if ((j < k) ? is_lt(pk, item(a, j)) : is_lt(item(a, j), pk)) {
+					fail("forsort_select", "not partitioned around k");
+					break;
+				}
+		}
+
+		// The stable variant must put exactly what a stable sort would
+		// at k, and nothing on the wrong side of it
+		for (size_t w = 0; w < 2; w++) {
+			const char *name = w ? "forsort_select_stable dynamic" : "forsort_select_stable";
+
+			memcpy(a, orig, n * es);
+			forsort_select_stable(a, n, k, es, is_lt, NULL, w);
+			checks++;
+			if (!check_perm(name, a))
+				continue;
+			if (memcmp(pk, item(ref, k), es))
+				fail(name, "wrong item at k");
+			for (size_t j = 0; j < n; j++)
+				if ((j < k) ? (cmp_key_tag(item(a, j), pk) > 0) : (cmp_key_tag(item(a, j), pk) < 0)) {
+					fail(name, "not stably partitioned around k");
+					break;
+				}
+		}
+	}
+} // check_select
+
+
+// Sorts each of the K runs given by OFFSETS into reference order
+static void
+sort_runs(const size_t *offsets, size_t k)
+{
+	memcpy(a, orig, n * es);
+	for (size_t i = 0; i < k; i++)
+		qsort(item(a, offsets[i]), offsets[i + 1] - offsets[i], es, cmp_key_tag);
+} // sort_runs
+
+
+static void
+check_merge(void)
+{
+	size_t	nas[] = {n / 3, n - (n / 20)};
+	size_t	nws = (n / 32) + 1;
+
+	for (size_t i = 0; i < (sizeof(nas) / sizeof(*nas)); i++) {
+		size_t	offsets[3] = {0, nas[i], n};
+
+		sort_runs(offsets, 2);
+		forsort_merge(a, nas[i], n - nas[i], es, is_lt, NULL, 0);
+		check_ref("forsort_merge");
+
+		sort_runs(offsets, 2);
+		forsort_merge(a, nas[i], n - nas[i], es, is_lt, NULL, 1);
+		check_ref("forsort_merge dynamic");
+
+		sort_runs(offsets, 2);
+		forsort_merge(a, nas[i], n - nas[i], es, is_lt, ws, nws * es);
+		check_ref("forsort_merge workspace");
+	}
+} // check_merge
+
+
+static void
+check_kmerge(void)
+{
+	size_t	offsets[10];
+	size_t	k = (random() % 8) + 1;
+
+	// Run boundaries are picked at random, so some runs come out empty
+	offsets[0] = 0;
+	offsets[k] = n;
+	for (size_t i = 1; i < k; i++)
+		offsets[i] = n ? random() % (n + 1) : 0;
+	for (size_t i = 1; i < k; i++)
+		for (size_t j = i; (j > 1) && (offsets[j] < offsets[j - 1]); j--) {
+			size_t	t = offsets[j];
+
+			offsets[j] = offsets[j - 1];
+			offsets[j - 1] = t;
+		}
+
+	sort_runs(offsets, k);
+	forsort_kmerge(a, offsets, k, es, is_lt, NULL, 0);
+	check_ref("forsort_kmerge");
+
+	sort_runs(offsets, k);
+	forsort_kmerge(a, offsets, k, es, is_lt, NULL, 1);
+	check_ref("forsort_kmerge dynamic");
+} // check_kmerge
+
+
+static void
+check_append(void)
+{
+	size_t	offsets[3] = {0, (n * 2) / 3, n};
+	size_t	ns = offsets[1];
+
+	sort_runs(offsets, 1);
+	forsort_append_sorted(a, ns, n - ns, es, is_lt, NULL, 1);
+	check_ref("forsort_append_sorted dynamic");
+
+	sort_runs(offsets, 1);
+	forsort_append_sorted(a, ns, n - ns, es, is_lt, ws, ((n / 16) + 1) * es);
+	check_ref("forsort_append_sorted workspace");
+
+	sort_runs(offsets, 1);
+	forsort_append_sorted(a, ns, n - ns, es, is_lt, NULL, 0);
+	check_sort("forsort_append_sorted", false);
+} // check_append
+
+
+// Builds a set that is made up of sorted runs, and checks that the same run
+// boundaries come back as a simple scan finds
+static void
+check_runs(void)
+{
+	size_t	offsets[34], expect[34], k = 0;
+
+	offsets[0] = 0;
+	for (size_t i = 0; i < n; ) {
+		i += (random() % ((n / 4) + 1)) + 1;
+		if ((i > n) || (k == 31))
+			i = n;
+		offsets[++k] = i;
+	}
+	sort_runs(offsets, k);
+	memcpy(ws, a, n * es);
+
+	size_t	nexp = 0;
+
+	expect[0] = 0;
+	for (size_t i = 1; i < n; i++)
+		if (is_lt(item(a, i), item(a, i - 1)))
+			expect[++nexp] = i;
+	if (n > 0)
+		expect[++nexp] = n;
+
+	checks++;
+	if (forsort_runs(a, n, es, is_lt, NULL, 0) != nexp) {
+		fail("forsort_runs", "wrong number of runs");
+		return;
+	}
+
+	// Fill in just half of the boundaries, with a guard past the end
+	size_t	half = (nexp + 2) / 2;
+
+	memset(offsets, 0xff, sizeof(offsets));
+	if ((forsort_runs(a, n, es, is_lt, offsets, half) != nexp) ||
+	    memcmp(offsets, expect, half * sizeof(*offsets)) || (offsets[half] != SIZE_MAX)) {
+		fail("forsort_runs", "wrong partial run boundaries");
+		return;
+	}
+
+	if ((forsort_runs(a, n, es, is_lt, offsets, nexp + 1) != nexp) ||
+	    memcmp(offsets, expect, (nexp + 1) * sizeof(*offsets)))
+		fail("forsort_runs", "wrong run boundaries");
+	if (memcmp(a, ws, n * es))
+		fail("forsort_runs", "modified the array");
+} // check_runs
+
+
+// Each key's first item in the reference is the one that has to be kept
+static void
+check_unique_front(const char *name, size_t u)
+{
+	size_t	j = 0;
+
+	for (size_t i = 0; i < u; i++, j++) {
+		while ((j > 0) && (j < n) && (key_of(item(ref, j)) == key_of(item(ref, j - 1))))
+			j++;
+		if ((j >= n) || memcmp(item(a, i), item(ref, j), es)) {
+			fail(name, "front is not the first item of each key");
+			return;
+		}
+	}
+	while ((j > 0) && (j < n) && (key_of(item(ref, j)) == key_of(item(ref, j - 1))))
+		j++;
+	if (j < n)
+		fail(name, "wrong number of unique keys");
+} // check_unique_front
+
+
+static uint32_t	*reduce_last = NULL;
+static size_t	reduce_calls = 0;
+static bool	reduce_ok = true;
+
+// Each item must be folded into the first item with the same key, and in the
+// order that the items were given in
+static void
+reduce_combine(void *acc, const void *p)
+{
+	uint32_t	ta = tag_of(acc), tp = tag_of(p);
+
+	reduce_calls++;
+	if ((key_of(acc) != key_of(p)) || (ta >= n) || (tp <= reduce_last[ta]))
+		reduce_ok = false;
+	else
+		reduce_last[ta] = tp;
+} // reduce_combine
+
+
+static void
+check_unique(void)
+{
+	size_t	u;
+
+	memcpy(a, orig, n * es);
+	u = forsort_unique(a, n, es, is_lt);
+	checks++;
+	if (check_perm("forsort_unique", a))
+		check_unique_front("forsort_unique", u);
+
+	for (size_t i = 0; i < n; i++)
+		reduce_last[i] = i;
+	reduce_calls = 0;
+	reduce_ok = true;
+
+	memcpy(a, orig, n * es);
+	u = forsort_reduce(a, n, es, is_lt, reduce_combine);
+	checks++;
+	if (!reduce_ok || (reduce_calls != (n - u)))
+		fail("forsort_reduce", "combine was called out of order");
+	if (check_perm("forsort_reduce", a))
+		check_unique_front("forsort_reduce", u);
+} // check_unique
+
+
+static int
+is_odd(const void *p)
+{
+	return key_of(p) & 1;
+} // is_odd
+
+
+static void
+check_partition(void)
+{
+	size_t	expect = 0;
+
+	for (size_t i = 0; i < n; i++)
+		expect += is_odd(item(orig, i));
+
+	for (size_t w = 0; w < 3; w++) {
+		const char *name = (w == 0) ? "forsort_stable_partition" :
+				   (w == 1) ? "forsort_stable_partition dynamic" :
+					      "forsort_stable_partition workspace";
+		size_t	np;
+
+		memcpy(a, orig, n * es);
+		if (w == 2)
+			np = forsort_stable_partition(a, n, es, is_odd, ws, ((n / 8) + 1) * es);
+		else
+			np = forsort_stable_partition(a, n, es, is_odd, NULL, w);
+
+		checks++;
+		if (!check_perm(name, a))
+			continue;
+		if (np != expect) {
+			fail(name, "wrong count");
+			continue;
+		}
+		for (size_t i = 0; i < n; i++)
+			if ((is_odd(item(a, i)) != (i < np)) ||
+			    ((i != 0) && (i != np) && (tag_of(item(a, i)) < tag_of(item(a, i - 1))))) {
+				fail(name, "not stably partitioned");
+				break;
+			}
+	}
+} // check_partition
+
+
+// A prefix of the key with its low bits dropped, so that plenty of prefixes
+// tie and the caller's comparator gets used as well
+static uint64_t
+key_prefix(const void *p)
+{
+	return key_of(p) >> 4;
+} // key_prefix
+
+
+static int
+is_lt_ptr(const void *p1, const void *p2)
+{
+	return is_lt(*(void * const *)p1, *(void * const *)p2);
+} // is_lt_ptr
+
+
+static void
+check_prefix(void)
+{
+	void	**ptrs = malloc((n ? n : 1) * sizeof(*ptrs));
+
+	if (ptrs == NULL) {
+		fail("forsort_prefix", "out of memory");
+		return;
+	}
+
+	memcpy(a, orig, n * es);
+	for (size_t i = 0; i < n; i++)
+		ptrs[i] = item(a, i);
+
+	forsort_prefix(ptrs, n, key_prefix, is_lt_ptr);
+
+	// The items never move, so each pointer can be checked by its tag
+	checks++;
+	memset(seen, 0, n * sizeof(*seen));
+	for (size_t i = 0; i < n; i++) {
+		char	*p = ptrs[i];
+		uint32_t t = tag_of(p);
+
+		if ((t >= n) || seen[t] || (p != item(a, t))) {
+			fail("forsort_prefix", "not a permutation of the input");
+			break;
+		}
+		seen[t] = true;
+		if ((i > 0) && (cmp_key_tag(ptrs[i - 1], p) > 0)) {
+			fail("forsort_prefix", "not sorted, or not stable");
+			break;
+		}
+	}
+	free(ptrs);
+} // check_prefix
+
+
+// Strings are made from a small alphabet, and often share a long start, so
+// that there are plenty of equal strings and of equal 8 byte prefixes
+static void
+check_strings(void)
+{
+	char	*pool = malloc((n ? n : 1) * 16), **strs = malloc((n ? n : 1) * sizeof(*strs));
+
+	if ((pool == NULL) || (strs == NULL)) {
+		fail("forsort_strings", "out of memory");
+		goto strings_done;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		char	*s = pool + (i * 16);
+		size_t	len = random() % 15, j = 0;
+
+		if (random() & 1)
+			for (; (j < len) && (j < 10); j++)
+				s[j] = "abcdefghij"[j];
+		for (; j < len; j++)
+			s[j] = 'a' + (random() % 3);
+		s[len] = '\0';
+		strs[i] = s;
+	}
+
+	forsort_strings(strs, n);
+
+	checks++;
+	memset(seen, 0, n * sizeof(*seen));
+	for (size_t i = 0; i < n; i++) {
+		size_t	t = (strs[i] - pool) / 16;
+
+		if ((t >= n) || seen[t] || (strs[i] != pool + (t * 16))) {
+			fail("forsort_strings", "not a permutation of the input");
+			break;
+		}
+		seen[t] = true;
+
+		int	res = i ? strcmp(strs[i - 1], strs[i]) : 0;
+
+		if ((res > 0) || ((res == 0) && (i > 0) && (strs[i - 1] > strs[i]))) {
+			fail("forsort_strings", "not sorted, or not stable");
+			break;
+		}
+	}
+
+strings_done:
+	free(strs);
+	free(pool);
+} // check_strings
+
+
+static int
+is_lt_u32(const void *p1, const void *p2)
+{
+	return *(const uint32_t *)p1 < *(const uint32_t *)p2;
+} // is_lt_u32
+
+
+// Sorts whole items as keys with their tags as a payload, and then bare
+// 32-bit keys with whole items as the payload
+static void
+check_cosort(void)
+{
+	uint32_t *tags = malloc((n ? n : 1) * sizeof(*tags));
+	uint32_t *keys = malloc((n ? n : 1) * sizeof(*keys));
+
+	if ((tags == NULL) || (keys == NULL)) {
+		fail("forsort_cosort", "out of memory");
+		goto cosort_done;
+	}
+
+	memcpy(a, orig, n * es);
+	for (size_t i = 0; i < n; i++)
+		tags[i] = i;
+
+	void	*pay1[1] = {tags};
+	size_t	pes1[1] = {sizeof(*tags)};
+
+	if (forsort_cosort(a, n, es, is_lt, pay1, pes1, 1) < 0) {
+		fail("forsort_cosort", "failed");
+	} else {
+		check_ref("forsort_cosort");
+		for (size_t i = 0; i < n; i++)
+			if (tags[i] != tag_of(item(a, i))) {
+				fail("forsort_cosort", "payload was not reordered with the keys");
+				break;
+			}
+	}
+
+	memcpy(a, orig, n * es);
+	for (size_t i = 0; i < n; i++)
+		keys[i] = key_of(item(a, i));
+
+	void	*pay2[1] = {a};
+	size_t	pes2[1] = {es};
+
+	if (forsort_cosort(keys, n, sizeof(*keys), is_lt_u32, pay2, pes2, 1) < 0) {
+		fail("forsort_cosort keys", "failed");
+	} else {
+		check_ref("forsort_cosort keys");
+		for (size_t i = 0; i < n; i++)
+			if (keys[i] != key_of(item(a, i))) {
+				fail("forsort_cosort keys", "payload was not reordered with the keys");
+				break;
+			}
+	}
+
+cosort_done:
+	free(keys);
+	free(tags);
+} // check_cosort
+
+
+// Reads the sorted set back from the start of FD into A, and checks it
+static void
+check_fd(const char *name, int fd)
+{
+	if (pread(fd, a, n * es, 0) != (ssize_t)(n * es))
+		fail(name, "unable to read the sorted file");
+	else
+		check_ref(name);
+} // check_fd
+
+
+// Writes the set out to a file and sorts it there, first with an external
+// merge in a budget small enough to make many runs, and then in place.  The
+// descriptor based sorts write out to a second file
+static void
+check_file(void)
+{
+	char	path[] = "/tmp/forsort-check-XXXXXX", opath[] = "/tmp/forsort-check-XXXXXX";
+	int	fd = mkstemp(path), ofd = mkstemp(opath);
+	forsort_file_opts_t opts = {8 << 10, NULL};
+	ssize_t	size = n * es;
+
+	if ((fd < 0) || (ofd < 0)) {
+		fail("forsort_file", "unable to create a temporary file");
+		goto file_done;
+	}
+
+	if (pwrite(fd, orig, size, 0) != size) {
+		fail("forsort_file", "unable to write the temporary file");
+		goto file_done;
+	}
+
+	if (forsort_file(path, path, es, is_lt, &opts) < 0)
+		fail("forsort_file", "failed");
+	else
+		check_fd("forsort_file", fd);
+
+	if ((pwrite(fd, orig, size, 0) != size) || (forsort_file_inplace(path, es, is_lt) < 0))
+		fail("forsort_file_inplace", "failed");
+	else
+		check_fd("forsort_file_inplace", fd);
+
+	if ((pwrite(fd, orig, size, 0) != size) || (lseek(fd, 0, SEEK_SET) < 0) ||
+	    (forsort_file_fd(fd, ofd, es, is_lt, &opts) < 0))
+		fail("forsort_file_fd", "failed");
+	else
+		check_fd("forsort_file_fd", ofd);
+
+	// Every record is within N places of where it belongs
+	if ((lseek(fd, 0, SEEK_SET) < 0) || (lseek(ofd, 0, SEEK_SET) < 0) ||
+	    (forsort_file_window(fd, ofd, es, is_lt, n + 1) < 0))
+		fail("forsort_file_window", "failed");
+	else
+		check_fd("forsort_file_window", ofd);
+
+file_done:
+	if (fd >= 0) {
+		close(fd);
+		unlink(path);
+	}
+	if (ofd >= 0) {
+		close(ofd);
+		unlink(opath);
+	}
+} // check_file
+
+
+// Runs every check over the set currently generated
+static void
+check_all(void)
+{
+	generate();
+	check_sorts();
+	check_batch(NULL, "forsort_batch");
+	check_batch(ctx, "forsort_batch_ctx");
+	check_partial();
+	check_select();
+	check_merge();
+	check_kmerge();
+	check_append();
+	check_runs();
+	check_unique();
+	check_partition();
+	check_prefix();
+	check_cosort();
+	check_file();
+	if (es == check_es[0])
+		check_strings();
+} // check_all
+
+
+static void
+check_few_keys(void)
+{
+	char	path[] = "/tmp/forsort-check-XXXXXX";
+	int	fd = mkstemp(path);
+
+	es = 12;
+	n = FEW_KEYS_N;
+	nkeys = FEW_KEYS;
+	generate();
+
+	memcpy(a, orig, n * es);
+	forsort_stable(a, n, es, is_lt);
+	check_ref("forsort_stable");
+
+	if (fd < 0) {
+		fail("forsort_file_inplace", "unable to create a temporary file");
+		return;
+	}
+	if ((pwrite(fd, orig, n * es, 0) != (ssize_t)(n * es)) ||
+	    (forsort_file_inplace(path, es, is_lt) < 0))
+		fail("forsort_file_inplace", "failed");
+	else
+		check_fd("forsort_file_inplace", fd);
+	close(fd);
+	unlink(path);
+} // check_few_keys
+
+
+// Smaller sets with a few dozen keys at most once left stable_sort() with
+// no work-space for its merges, which then were not sort-stable
+static void
+check_small_few_keys(void)
+{
+	for (size_t i = 0; i < SMALL_FEW_KEYS_SETS; i++) {
+		es = check_es[i % (sizeof(check_es) / sizeof(*check_es))];
+		n = (random() % 2981) + 20;
+		nkeys = (random() % 38) + 2;
+		generate();
+
+		memcpy(a, orig, n * es);
+		forsort_stable(a, n, es, is_lt);
+		check_ref("forsort_stable");
+	}
+} // check_small_few_keys
+
+
+// Sets up for sets of up to MAXN items of up to MAXES bytes
+static bool
+check_alloc(size_t maxn, size_t maxes)
+{
+	size_t	size = (maxn ? maxn : 1) * maxes;
+
+	orig = malloc(size);
+	ref = malloc(size);
+	a = malloc(size);
+	ws = malloc(size);
+	seen = malloc((maxn ? maxn : 1) * sizeof(*seen));
+	reduce_last = malloc((maxn ? maxn : 1) * sizeof(*reduce_last));
+	return orig && ref && a && ws && seen && reduce_last;
+} // check_alloc
+
+
+int
+main(int argc, char *argv[])
+{
+	forsort_opts_t	opts = {2, 16, 4096};
+	size_t		maxn = FEW_KEYS_N, maxes = 0;
+
+	for (size_t i = 0; i < (sizeof(check_n) / sizeof(*check_n)); i++)
+		if (check_n[i] > maxn)
+			maxn = check_n[i];
+	for (size_t i = 0; i < (sizeof(check_es) / sizeof(*check_es)); i++)
+		if (check_es[i] > maxes)
+			maxes = check_es[i];
+
+	ctx = forsort_ctx_create(NULL);
+	ctx_opts = forsort_ctx_create(&opts);
+	if (!ctx || !ctx_opts || !check_alloc(maxn, maxes)) {
+		fprintf(stderr, "%s: out of memory\n", argv[0]);
+		return 1;
+	}
+
+	srandom(1);
+	for (size_t i = 0; i < (sizeof(check_es) / sizeof(*check_es)); i++) {
+		es = check_es[i];
+		for (size_t j = 0; j < (sizeof(check_n) / sizeof(*check_n)); j++) {
+			n = check_n[j];
+			for (size_t k = 0; k < (sizeof(check_keys) / sizeof(*check_keys)); k++) {
+				nkeys = check_keys[k] ? check_keys[k] : (n ? n : 1);
+				check_all();
+			}
+		}
+	}
+
+	check_few_keys();
+	check_small_few_keys();
+
+	forsort_ctx_destroy(ctx_opts);
+	forsort_ctx_destroy(ctx);
+
+	printf("%zu checks, %zu failures\n", checks, failures);
+	return failures ? 1 : 0;
+} // main
@@ -0,0 +1,295 @@
+//				FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)	Copyright (C) 2021-2025
+//
+// forsort-file - Sorts files of fixed size binary records by a key held at a
+// fixed offset within each record
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "forsort.h"
+#include "forsort-file.h"
+
+static	size_t	record_size = 0;
+static	size_t	key_offset = 0;
+static	size_t	key_size = 0;
+static	int	(*key_lt)(const void *, const void *) = NULL;
+
+#define	KEY_LT(_type_)							\
+static int								\
+is_lt_##_type_(const void *p1, const void *p2)				\
+{									\
+	_type_	k1, k2;							\
+									\
+	memcpy(&k1, (const char *)p1 + key_offset, sizeof(k1));	\
+	memcpy(&k2, (const char *)p2 + key_offset, sizeof(k2));	\
+	return k1 < k2;							\
+}
+
+KEY_LT(uint32_t)
+KEY_LT(uint64_t)
+KEY_LT(int32_t)
+KEY_LT(int64_t)
+KEY_LT(double)
+
+// Keys of type 'bytes' compare as unsigned byte strings, like memcmp() does
+static int
+is_lt_bytes(const void *p1, const void *p2)
+{
+	return memcmp((const char *)p1 + key_offset, (const char *)p2 + key_offset, key_size) < 0;
+} // is_lt_bytes
+
+
+static int
+is_gt_key(const void *p1, const void *p2)
+{
+	return key_lt(p2, p1);
+} // is_gt_key
+
+
+static const struct key_type {
+	const char	*name;
+	size_t		size;
+	int		(*is_lt)(const void *, const void *);
+} key_types[] = {
+	{ "u32",	sizeof(uint32_t),	is_lt_uint32_t },
+	{ "u64",	sizeof(uint64_t),	is_lt_uint64_t },
+	{ "i32",	sizeof(int32_t),	is_lt_int32_t },
+	{ "i64",	sizeof(int64_t),	is_lt_int64_t },
+	{ "f64",	sizeof(double),		is_lt_double },
+	{ "bytes",	0,			is_lt_bytes },
+	{ NULL,		0,			NULL }
+};
+
+
+static void
+usage(char *prog, const char *msg)
+{
+	if (msg)
+		fprintf(stderr, "\nError: %s\n", msg);
+	fprintf(stderr, "\nUsage: %s [options] --record-size <R> [-o <output>] [<input>]\n", prog);
+	fprintf(stderr, "\nSorts a file of fixed size binary records by a key within each record.  The\n");
+	fprintf(stderr, "sort is stable.  With -o, files larger than the memory budget are sorted in\n");
+	fprintf(stderr, "chunks, which are written out to temporary files and then merged.  Without -o,\n");
+	fprintf(stderr, "the input is mapped into memory and sorted in place, and so should fit in RAM\n");
+	fprintf(stderr, "\nIf <input> is - or is not given, records are read from standard input until\n");
+	fprintf(stderr, "end of file and are written to standard output, or to <output> if given.  An\n");
+	fprintf(stderr, "<output> of - is also standard output.  Memory use stays within the budget\n");
+	fprintf(stderr, "\nWith -k, the input is taken to be a stream that is already in order, apart from\n");
+	fprintf(stderr, "records being at most <W> places from where they belong.  It is sorted a window\n");
+	fprintf(stderr, "at a time in memory, and written to standard output unless -o is given\n\n");
+	fprintf(stderr, "[options] are zero or more of the following options\n");
+	fprintf(stderr, "  --record-size <R>  Size of each record in bytes (required)\n");
+	fprintf(stderr, "  --key-offset <K>   Byte offset of the key within each record (default=0)\n");
+	fprintf(stderr, "  --key-type <T>     One of u32, u64, i32, i64, f64 or bytes (default=u64)\n");
+	fprintf(stderr, "                     Numbers are read in the host's byte order\n");
+	fprintf(stderr, "  --key-size <L>     Length of a 'bytes' key (default=rest of the record)\n");
+	fprintf(stderr, "  -r, --reverse      Sort into descending order\n");
+	fprintf(stderr, "  -m, --memory <num> Memory budget in bytes.  A K, M or G suffix may be used\n");
+	fprintf(stderr, "                     (default=half of physical memory)\n");
+	fprintf(stderr, "  -T, --tmpdir <dir> Where to write sorted runs (default=$TMPDIR or /tmp)\n");
+	fprintf(stderr, "  -k, --window <W>   Most places that any record is out of order by.  A K, M\n");
+	fprintf(stderr, "                     or G suffix may be used\n");
+	fprintf(stderr, "  -o, --output <out> File to write the sorted records to.  It may be the input,\n");
+	fprintf(stderr, "                     except with -k.\n");
+	fprintf(stderr, "                     -m and -T apply to the external sort (not to -k or\n");
+	fprintf(stderr, "                     in-place sorts)\n");
+	exit(-1);
+} // usage
+
+
+// Parses a size with an optional K, M, G or T suffix.  Returns 0 if invalid
+static size_t
+parse_size(const char *str)
+{
+	char	*end;
+	size_t	val = strtoull(str, &end, 10);
+
+	switch (*end) {
+	case 'T': case 't':
+		val <<= 10;
+		// fall through
+	case 'G': case 'g':
+		val <<= 10;
+		// fall through
+	case 'M': case 'm':
+		val <<= 10;
+		// fall through
+	case 'K': case 'k':
+		val <<= 10;
+		end++;
+		break;
+	}
+
+	return (*end == '\0') ? val : 0;
+} // parse_size
+
+
+int
+main(int argc, char *argv[])
+{
+	const char	*key_type = "u64", *output = NULL;
+	forsort_file_opts_t opts = {0};
+	bool		reverse = false;
+	size_t		window = 0;
+	int		opt;
+
+	enum { OPT_RECORD_SIZE = 256, OPT_KEY_OFFSET, OPT_KEY_TYPE, OPT_KEY_SIZE };
+
+	static const struct option long_opts[] = {
+		{ "record-size",	required_argument,	NULL,	OPT_RECORD_SIZE },
+		{ "key-offset",		required_argument,	NULL,	OPT_KEY_OFFSET },
+		{ "key-type",		required_argument,	NULL,	OPT_KEY_TYPE },
+		{ "key-size",		required_argument,	NULL,	OPT_KEY_SIZE },
+		{ "reverse",		no_argument,		NULL,	'r' },
+		{ "memory",		required_argument,	NULL,	'm' },
+		{ "tmpdir",		required_argument,	NULL,	'T' },
+		{ "window",		required_argument,	NULL,	'k' },
+		{ "output",		required_argument,	NULL,	'o' },
+		{ "help",		no_argument,		NULL,	'h' },
+		{ NULL,			0,			NULL,	0 }
+	};
+
+	while ((opt = getopt_long(argc, argv, "rm:T:k:o:h", long_opts, NULL)) != -1) {
+		switch (opt) {
+		case OPT_RECORD_SIZE:
+			if ((record_size = parse_size(optarg)) == 0)
+				usage(argv[0], "Bad value specified for the record size");
+			break;
+		case OPT_KEY_OFFSET:
+			key_offset = strtoull(optarg, NULL, 10);
+			break;
+		case OPT_KEY_TYPE:
+			key_type = optarg;
+			break;
+		case OPT_KEY_SIZE:
+			if ((key_size = strtoull(optarg, NULL, 10)) == 0)
+				usage(argv[0], "Bad value specified for the key size");
+			break;
+		case 'r':
+			reverse = true;
+			break;
+		case 'm':
+			if ((opts.memory = parse_size(optarg)) == 0)
+				usage(argv[0], "Bad value specified for the memory budget");
+			break;
+		case 'T':
+			opts.tmpdir = optarg;
+			break;
+		case 'k':
+			if ((window = parse_size(optarg)) == 0)
+				usage(argv[0], "Bad value specified for the window");
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'h':
+			usage(argv[0], NULL);
+			break;
+		default:
+			usage(argv[0], "Unsupported option");
+		}
+	}
+
+	if (optind < (argc - 1))
+		usage(argv[0], "Only one input file may be given");
+
+	const char	*input = (optind < argc) ? argv[optind] : "-";
+	bool		in_std = !strcmp(input, "-");
+	bool		out_std = output && !strcmp(output, "-");
+
+	// Window sorts always stream, and default to standard output
+	if (window && (output == NULL))
+		out_std = true;
+
+	if (record_size == 0)
+		usage(argv[0], "The record size must be given");
+
+	const struct key_type *kt;
+
+	for (kt = key_types; kt->name && strcmp(kt->name, key_type); kt++);
+	if (kt->name == NULL)
+		usage(argv[0], "Unknown key type");
+
+	if (kt->size == 0) {
+		if (key_size == 0)
+			key_size = (key_offset < record_size) ? record_size - key_offset : 0;
+	} else {
+		key_size = kt->size;
+	}
+
+	if ((key_size == 0) || (key_offset > record_size) || (key_size > (record_size - key_offset)))
+		usage(argv[0], "The key must lie entirely within the record");
+
+	key_lt = kt->is_lt;
+
+	int	(*is_lt)(const void *, const void *) = reverse ? is_gt_key : key_lt;
+	int	res;
+
+	if (in_std || out_std || window) {
+		// Streaming to or from a pipe.  Only open what isn't standard I/O
+		int	in_fd = STDIN_FILENO, out_fd = STDOUT_FILENO;
+
+		if (!in_std && ((in_fd = open(input, O_RDONLY)) < 0)) {
+			fprintf(stderr, "%s: %s: %s\n", argv[0], input, strerror(errno));
+			return 1;
+		}
+
+		if (output && !out_std) {
+			struct stat ist, ost;
+
+			// A stream is written out as it's read in, so the output
+			// would be truncated before any of the input was read
+			if ((fstat(in_fd, &ist) == 0) && (stat(output, &ost) == 0) &&
+			    (ist.st_dev == ost.st_dev) && (ist.st_ino == ost.st_ino)) {
+				fprintf(stderr, "%s: %s: The output cannot be the input when streaming\n",
+					argv[0], output);
+				return 1;
+			}
+
+			out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+			if (out_fd < 0) {
+				fprintf(stderr, "%s: %s: %s\n", argv[0], output, strerror(errno));
+				return 1;
+			}
+		}
+
+		if (window)
+			res = forsort_file_window(in_fd, out_fd, record_size, is_lt, window);
+		else
+			res = forsort_file_fd(in_fd, out_fd, record_size, is_lt, &opts);
+		if ((close(out_fd) < 0) && (res == 0))
+			res = -1;
+	} else if (output) {
+		res = forsort_file(input, output, record_size, is_lt, &opts);
+	} else {
+		res = forsort_file_inplace(input, record_size, is_lt);
+	}
+
+	if (res < 0) {
+		if (in_std)
+			input = "standard input";
+		if (errno == ERANGE)
+			fprintf(stderr, "%s: %s is out of order by more than %zu records\n",
+				argv[0], input, window);
+		else if (errno == EINVAL)
+			fprintf(stderr, "%s: %s is not a whole number of %zu byte records\n",
+				argv[0], input, record_size);
+		else
+			fprintf(stderr, "%s: %s: %s\n", argv[0], input, strerror(errno));
+		return 1;
+	}
+
+	return 0;
+} // main
@@ -0,0 +1,765 @@
+//				FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)	Copyright (C) 2021-2025
+//
+// External merge sorting of files of fixed size records.  The input is read
+// in chunks, each of which is sorted with forsort_inplace() and then written
+// out as a sorted run to a temporary file.  The runs are then merged together
+// with a k-way merge into the output.
+//
+// Each chunk takes about 5/6ths of the memory budget, as bigger chunks make
+// for fewer runs to merge.  forsort_inplace() gets 1/16th of a chunk as its
+// work-space.  While a chunk is being sorted, the start of the next chunk is
+// read on another thread into a buffer that's 1/8th of a chunk in size, which
+// also lets whatever is writing into a pipe carry on.  The rest of the next
+// chunk is read in once the sort is done, and each sorted run is written out
+// with plain writes that the kernel's page cache writes behind.  Splitting
+// the budget into three chunks, so that a whole chunk could be read and
+// another written while a third was sorted, made three times as many runs,
+// and that was slower overall.
+//
+// The merge writes out one output buffer on another thread while it fills
+// the next.  The reads of each run are not overlapped though.  Each run's
+// buffer is refilled with a blocking read when it runs dry, and the kernel is
+// only asked to read ahead the part of the run that will be needed next.
+//
+// Files that fit in the page cache can instead be mapped into memory and
+// sorted right where they are with forsort_stable(), without any work-space.
+//
+// Streams that are already in order, give or take a bounded window, can be
+// sorted a window at a time in O(W) memory, with no temporary files at all.
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <pthread.h>
+#include "forsort.h"
+#include "forsort-file.h"
+
+
+//				TUNING KNOBS!
+//
+// FILE_WSRATIO and FILE_STAGE_RATIO set how the memory budget is split up
+// while sorting chunks.  The work-space that is handed to forsort_inplace()
+// is 1/FILE_WSRATIO of the chunk, and the buffer that the start of the next
+// chunk is read ahead into is 1/FILE_STAGE_RATIO of it.  The chunk gets the
+// rest, which is about 5/6ths of the budget
+#define	FILE_WSRATIO		16
+#define	FILE_STAGE_RATIO	8
+
+// FILE_MERGE_BUF_MIN is the smallest buffer, in bytes, that each run gets to
+// read into while being merged.  When there are too many runs for each to get
+// at least this much, the runs are merged in groups over multiple passes
+#define	FILE_MERGE_BUF_MIN	(1 << 20)
+
+#define	MIN(_x_, _y_)  (((_x_) < (_y_)) ? (_x_) : (_y_))
+
+struct file_run {
+	off_t	offset;		// Byte offset of the run in its file
+	size_t	n;		// Number of records in the run
+};
+
+struct file_reader {
+	int	fd;
+	off_t	offset;		// Byte offset of the next read
+	size_t	left;		// Records that are yet to be read in
+	size_t	size;		// Size of the buffer in bytes
+	char	*buf, *cur, *end;
+};
+
+// A read or write that runs on a thread of its own.  If the thread can't be
+// started then the I/O is just done there and then instead
+struct file_io {
+	pthread_t	tid;
+	bool		busy;		// Started, but not yet waited for
+	bool		threaded;	// Running on tid
+	bool		write;
+	int		fd;
+	char		*buf;
+	size_t		len;
+	ssize_t		res;		// As for read_full() or write_full()
+	int		err;		// errno from the thread, if res < 0
+};
+
+
+// Reads until LEN bytes have been read, or end of file is reached.  Returns
+// how many bytes were read, or -1 on an error
+static ssize_t
+read_full(int fd, void *buf, size_t len)
+{
+	size_t	got = 0;
+
+	while (got < len) {
+		ssize_t	res = read(fd, (char *)buf + got, len - got);
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (res == 0)
+			break;
+		got += res;
+	}
+
+	return got;
+} // read_full
+
+
+static ssize_t
+pread_full(int fd, void *buf, size_t len, off_t offset)
+{
+	size_t	got = 0;
+
+	while (got < len) {
+		ssize_t	res = pread(fd, (char *)buf + got, len - got, offset + got);
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (res == 0)
+			break;
+		got += res;
+	}
+
+	return got;
+} // pread_full
+
+
+static int
+write_full(int fd, const void *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t	res = write(fd, buf, len);
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf = (const char *)buf + res;
+		len -= res;
+	}
+
+	return 0;
+} // write_full
+
+
+static void *
+io_run(void *p)
+{
+	struct file_io *io = p;
+
+	if (io->write)
+		io->res = write_full(io->fd, io->buf, io->len);
+	else
+		io->res = read_full(io->fd, io->buf, io->len);
+	io->err = errno;
+	return NULL;
+} // io_run
+
+
+// Starts reading or writing LEN bytes of BUF from or to FD in the background.
+// Only one I/O may be in flight on each file_io at a time
+static void
+io_start(struct file_io *io, bool write, int fd, char *buf, size_t len)
+{
+	io->write = write;
+	io->fd = fd;
+	io->buf = buf;
+	io->len = len;
+	io->busy = true;
+	io->threaded = (pthread_create(&io->tid, NULL, io_run, io) == 0);
+	if (!io->threaded)
+		io_run(io);
+} // io_start
+
+
+// Waits for IO to finish, and returns its result.  Returns 0 if there was
+// nothing in flight, and sets errno if the I/O failed
+static ssize_t
+io_wait(struct file_io *io)
+{
+	if (!io->busy)
+		return 0;
+
+	if (io->threaded)
+		pthread_join(io->tid, NULL);
+	io->busy = false;
+
+	if (io->res < 0)
+		errno = io->err;
+	return io->res;
+} // io_wait
+
+
+// Creates an anonymous temporary file in TMPDIR.  It is unlinked straight
+// away, so it goes away by itself when closed, even if we crash
+static int
+make_temp(const char *tmpdir)
+{
+	char	*path;
+	int	fd;
+
+	if (tmpdir == NULL)
+		tmpdir = getenv("TMPDIR");
+	if ((tmpdir == NULL) || (*tmpdir == '\0'))
+		tmpdir = "/tmp";
+
+	if (asprintf(&path, "%s/forsort.XXXXXX", tmpdir) < 0)
+		return -1;
+
+	if ((fd = mkstemp(path)) >= 0)
+		unlink(path);
+
+	free(path);
+	return fd;
+} // make_temp
+
+
+static size_t
+default_memory()
+{
+	long	pages = sysconf(_SC_PHYS_PAGES);
+	long	pagesize = sysconf(_SC_PAGESIZE);
+
+	if ((pages <= 0) || (pagesize <= 0))
+		return (size_t)1 << 30;
+
+	return ((size_t)pages * pagesize) / 2;
+} // default_memory
+
+
+// Fills R's buffer with as much of what's left of its run as will fit.
+// Returns the number of records read in, or -1 on an error
+static ssize_t
+reader_fill(struct file_reader *r, const size_t es)
+{
+	size_t	n = MIN(r->left, r->size / es);
+	size_t	len = n * es;
+
+	if (n == 0)
+		return 0;
+
+	ssize_t	got = pread_full(r->fd, r->buf, len, r->offset);
+
+	if (got < 0)
+		return -1;
+
+	// The run was written by us, so coming up short means it got truncated
+	if ((size_t)got != len) {
+		errno = EIO;
+		return -1;
+	}
+
+	r->offset += len;
+	r->left -= n;
+	r->cur = r->buf;
+	r->end = r->buf + len;
+
+	// Have the kernel start reading in the next buffer's worth of the run
+	// while we work our way through this one
+	if (r->left > 0)
+		posix_fadvise(r->fd, r->offset, MIN(r->left * es, r->size), POSIX_FADV_WILLNEED);
+	return n;
+} // reader_fill
+
+
+// Orders the readers by their current record.  A tie goes to the reader of
+// the earlier run, which is what keeps the merge sort-stable
+static inline int
+reader_lt(struct file_reader *readers, size_t i, size_t j,
+	int (*is_lt)(const void *, const void *))
+{
+	if (is_lt(readers[i].cur, readers[j].cur))
+		return 1;
+	if (is_lt(readers[j].cur, readers[i].cur))
+		return 0;
+	return i < j;
+} // reader_lt
+
+
+static void
+heap_sift_down(size_t *heap, size_t nh, size_t pos, struct file_reader *readers,
+	int (*is_lt)(const void *, const void *))
+{
+	size_t	top = heap[pos];
+
+	for (size_t child; (child = (pos << 1) + 1) < nh; pos = child) {
+		if (((child + 1) < nh) && reader_lt(readers, heap[child + 1], heap[child], is_lt))
+			child++;
+		if (!reader_lt(readers, heap[child], top, is_lt))
+			break;
+		heap[pos] = heap[child];
+	}
+	heap[pos] = top;
+} // heap_sift_down
+
+
+// Merges the K runs in IN_FD together, and writes the result out to OUT_FD.
+// MEM is split up evenly between the K run buffers and two output buffers, so
+// that one output buffer can be written out while the other is filled
+static int
+merge_runs(const struct file_run *runs, const size_t k, int in_fd, int out_fd,
+	char *mem, const size_t memsize, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	size_t	bsize = ((memsize / (k + 2)) / es) * es;
+	struct file_reader *readers = NULL;
+	struct file_io wio = {0};
+	size_t	*heap = NULL, nh = 0;
+	int	ret = -1, err;
+
+	if (bsize == 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if ((readers = calloc(k, sizeof(*readers))) == NULL)
+		goto merge_done;
+	if ((heap = malloc(k * sizeof(*heap))) == NULL)
+		goto merge_done;
+
+	for (size_t i = 0; i < k; i++) {
+		struct file_reader *r = readers + i;
+		ssize_t	got;
+
+		r->fd = in_fd;
+		r->offset = runs[i].offset;
+		r->left = runs[i].n;
+		r->size = bsize;
+		r->buf = mem + (i * bsize);
+		if ((got = reader_fill(r, es)) < 0)
+			goto merge_done;
+		if (got > 0)
+			heap[nh++] = i;
+	}
+
+	for (size_t pos = nh >> 1; pos-- > 0; )
+		heap_sift_down(heap, nh, pos, readers, is_lt);
+
+	char	*obufs[2] = { mem + (k * bsize), mem + ((k + 1) * bsize) };
+	char	*ob = obufs[0], *op = ob, *oe = ob + bsize;
+
+	while (nh > 0) {
+		struct file_reader *r = readers + heap[0];
+
+		memcpy(op, r->cur, es);
+		if ((op += es) == oe) {
+			if (io_wait(&wio) < 0)
+				goto merge_done;
+			io_start(&wio, true, out_fd, ob, op - ob);
+			ob = (ob == obufs[0]) ? obufs[1] : obufs[0];
+			op = ob;
+			oe = ob + bsize;
+		}
+
+		if ((r->cur += es) == r->end) {
+			ssize_t	got = reader_fill(r, es);
+
+			if (got < 0)
+				goto merge_done;
+			if (got == 0)
+				heap[0] = heap[--nh];
+		}
+
+		if (nh > 1)
+			heap_sift_down(heap, nh, 0, readers, is_lt);
+	}
+
+	if (io_wait(&wio) < 0)
+		goto merge_done;
+	if (write_full(out_fd, ob, op - ob) < 0)
+		goto merge_done;
+
+	ret = 0;
+
+merge_done:
+	err = errno;
+	io_wait(&wio);
+	free(heap);
+	free(readers);
+	errno = err;
+	return ret;
+} // merge_runs
+
+
+// Merges groups of up to FANIN runs from IN_FD into a new temporary file,
+// over and over, until there are no more than FANIN runs left.  Returns the
+// file descriptor that holds the remaining runs, or -1 on an error
+static int
+merge_passes(struct file_run *runs, size_t *nruns, int in_fd, const size_t fanin,
+	const char *tmpdir, char *mem, const size_t memsize, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	while (*nruns > fanin) {
+		int	out_fd = make_temp(tmpdir);
+		off_t	offset = 0;
+		size_t	nout = 0;
+
+		if (out_fd < 0) {
+			close(in_fd);
+			return -1;
+		}
+
+		for (size_t i = 0; i < *nruns; i += fanin) {
+			size_t	k = MIN(fanin, *nruns - i), n = 0;
+
+			for (size_t j = 0; j < k; j++)
+				n += runs[i + j].n;
+
+			if (merge_runs(runs + i, k, in_fd, out_fd, mem, memsize, es, is_lt) < 0) {
+				int	err = errno;
+
+				close(out_fd);
+				close(in_fd);
+				errno = err;
+				return -1;
+			}
+
+			// The output runs always go in before the runs they came from
+			runs[nout].offset = offset;
+			runs[nout++].n = n;
+			offset += n * es;
+		}
+
+		close(in_fd);
+		in_fd = out_fd;
+		*nruns = nout;
+	}
+
+	return in_fd;
+} // merge_passes
+
+
+// Opens the output file OUT, once all of the input has been read in.  If OUT
+// is NULL then the caller's OUT_FD is written to instead
+static int
+open_output(const char *out, int out_fd)
+{
+	if (out == NULL)
+		return out_fd;
+
+	return open(out, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+} // open_output
+
+
+// Reads records from IN_FD until end of file, sorting them in chunks, and then
+// writes them all out in order to either the file OUT, or to OUT_FD.  Neither
+// file descriptor needs to be seekable, so pipes and sockets are fine.  Memory
+// use never goes beyond the budget, plus a few bytes for each run
+static int
+external_sort(int in_fd, const char *out, int out_fd, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	const forsort_file_opts_t *opts)
+{
+	size_t	memory = (opts && opts->memory) ? opts->memory : default_memory();
+	const char *tmpdir = opts ? opts->tmpdir : NULL;
+	struct file_run *runs = NULL;
+	struct file_io rio = {0};
+	size_t	nruns = 0, maxruns = 0;
+	int	fd = -1, tmp_fd = -1, ret = -1, err;
+	off_t	offset = 0;
+	char	*mem = NULL;
+
+	if (es == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// The chunk, its work-space and the read ahead buffer all need room
+	// for at least one record
+	const size_t	wsr = FILE_WSRATIO, sr = FILE_STAGE_RATIO;
+	size_t	nc = ((memory / es) * wsr * sr) / ((wsr * sr) + wsr + sr);
+	size_t	chunk = nc * es, stage = ((nc / sr) ? (nc / sr) : 1) * es;
+
+	if ((nc == 0) || ((chunk + stage + es) > memory)) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if ((mem = malloc(memory)) == NULL)
+		goto file_done;
+
+	char	*buf = mem, *sbuf = mem + chunk, *ws = sbuf + stage;
+
+	io_start(&rio, false, in_fd, sbuf, stage);
+
+	// Generate the sorted runs
+	for (;;) {
+		// The start of this chunk was read ahead while the last one was
+		// being sorted.  Only a full read ahead can have more after it
+		ssize_t	got = io_wait(&rio);
+
+		if (got < 0)
+			goto file_done;
+		memcpy(buf, sbuf, got);
+
+		if ((size_t)got == stage) {
+			ssize_t	rest = read_full(in_fd, buf + stage, chunk - stage);
+
+			if (rest < 0)
+				goto file_done;
+			got += rest;
+		}
+
+		if ((got % es) != 0) {
+			errno = EINVAL;
+			goto file_done;
+		}
+
+		// Only a full chunk can have more input after it
+		if ((size_t)got == chunk)
+			io_start(&rio, false, in_fd, sbuf, stage);
+
+		if (got > 0)
+			forsort_inplace(buf, got / es, es, is_lt, ws, memory - chunk - stage);
+
+		// If all of the input fits in one chunk, we're basically done
+		if ((nruns == 0) && ((size_t)got < chunk)) {
+			if ((fd = open_output(out, out_fd)) < 0)
+				goto file_done;
+			if (write_full(fd, buf, got) < 0)
+				goto file_done;
+			ret = 0;
+			goto file_done;
+		}
+
+		if (got == 0)
+			break;
+
+		if ((tmp_fd < 0) && ((tmp_fd = make_temp(tmpdir)) < 0))
+			goto file_done;
+
+		if (write_full(tmp_fd, buf, got) < 0)
+			goto file_done;
+
+		if (nruns == maxruns) {
+			size_t	newmax = maxruns ? maxruns << 1 : 64;
+			struct file_run *nr = realloc(runs, newmax * sizeof(*runs));
+
+			if (nr == NULL)
+				goto file_done;
+			runs = nr;
+			maxruns = newmax;
+		}
+
+		runs[nruns].offset = offset;
+		runs[nruns++].n = got / es;
+		offset += got;
+
+		if ((size_t)got < chunk)
+			break;
+	}
+
+	// Two of the merge buffers are for the output
+	size_t	fanin = memory / FILE_MERGE_BUF_MIN;
+
+	fanin = (fanin > 4) ? fanin - 2 : 2;
+
+	tmp_fd = merge_passes(runs, &nruns, tmp_fd, fanin, tmpdir, mem, memory, es, is_lt);
+	if (tmp_fd < 0)
+		goto file_done;
+
+	if ((fd = open_output(out, out_fd)) < 0)
+		goto file_done;
+
+	if (merge_runs(runs, nruns, tmp_fd, fd, mem, memory, es, is_lt) < 0)
+		goto file_done;
+
+	ret = 0;
+
+file_done:
+	err = errno;
+	io_wait(&rio);
+	if (out && (fd >= 0) && (close(fd) < 0) && (ret == 0)) {
+		err = errno;
+		ret = -1;
+	}
+	if (tmp_fd >= 0)
+		close(tmp_fd);
+	free(runs);
+	free(mem);
+	errno = err;
+	return ret;
+} // external_sort
+
+
+// The output is only opened once the input has been read in full, so that
+// the input and output can be the same file
+int
+forsort_file(const char *in, const char *out, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	const forsort_file_opts_t *opts)
+{
+	int	in_fd, ret, err;
+
+	if ((in_fd = open(in, O_RDONLY)) < 0)
+		return -1;
+
+	ret = external_sort(in_fd, out, -1, es, is_lt, opts);
+
+	err = errno;
+	close(in_fd);
+	errno = err;
+	return ret;
+} // forsort_file
+
+
+int
+forsort_file_fd(int in_fd, int out_fd, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	const forsort_file_opts_t *opts)
+{
+	return external_sort(in_fd, NULL, out_fd, es, is_lt, opts);
+} // forsort_file_fd
+
+
+// Every record of a k-sorted stream lies within WINDOW places of where it
+// belongs.  So, once N records have been read in, the first N - WINDOW of them
+// in sorted order can be written out, as nothing still to come can go before
+// them.  The records are read in a window at a time.  Each new window is
+// sorted, and merged in behind the WINDOW records held back from the last
+// one, which both makes use of the work-space for a linear merge.  Only the
+// last WINDOW records are kept, and the rest are written out.
+int
+forsort_file_window(int in_fd, int out_fd, const size_t es,
+	int (*is_lt)(const void *, const void *), const size_t window)
+{
+	size_t	wsize = window * es, nt = 0;
+	bool	written = false;
+	int	ret = -1, err;
+	char	*buf, *ws, *last;
+
+	if ((es == 0) || (window == 0) || (window > ((SIZE_MAX / 4) / es))) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	// Room for the held back records plus a new window, a work-space that
+	// can hold a window, and a copy of the last record written out
+	if ((buf = malloc((wsize * 3) + es)) == NULL)
+		return -1;
+	ws = buf + (wsize * 2);
+	last = ws + wsize;
+
+	while (true) {
+		ssize_t	got = read_full(in_fd, buf + (nt * es), wsize);
+
+		if (got < 0)
+			goto window_done;
+
+		if ((got % es) != 0) {
+			errno = EINVAL;
+			goto window_done;
+		}
+
+		size_t	nn = got / es, n = nt + nn;
+
+		if (nn > 0) {
+			forsort_inplace(buf + (nt * es), nn, es, is_lt, ws, wsize);
+			forsort_merge(buf, nt, nn, es, is_lt, ws, wsize);
+		}
+
+		// At the end of the input, everything that's left is final
+		size_t	ne = ((size_t)got < wsize) ? n : n - MIN(n, window);
+
+		if (ne > 0) {
+			// Records that come before one already written out were
+			// further out of place than the window allows for
+			if (written && is_lt(buf, last)) {
+				errno = ERANGE;
+				goto window_done;
+			}
+
+			if (write_full(out_fd, buf, ne * es) < 0)
+				goto window_done;
+
+			memcpy(last, buf + ((ne - 1) * es), es);
+			written = true;
+			memmove(buf, buf + (ne * es), (n - ne) * es);
+		}
+		nt = n - ne;
+
+		if ((size_t)got < wsize)
+			break;
+	}
+
+	ret = 0;
+
+window_done:
+	err = errno;
+	free(buf);
+	errno = err;
+	return ret;
+} // forsort_file_window
+
+
+int
+forsort_file_inplace(const char *path, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	struct stat st;
+	int	fd, ret = -1, err;
+	void	*a;
+
+	if (es == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if ((fd = open(path, O_RDWR)) < 0)
+		return -1;
+
+	if (fstat(fd, &st) < 0)
+		goto inplace_done;
+
+	if ((st.st_size % es) != 0) {
+		errno = EINVAL;
+		goto inplace_done;
+	}
+
+	// There's nothing to sort, and mmap() won't map a zero length file
+	if (st.st_size == 0) {
+		ret = 0;
+		goto inplace_done;
+	}
+
+	a = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (a == MAP_FAILED)
+		goto inplace_done;
+
+	// The first thing the sort does is scan the whole file from the start,
+	// so ask for all of it to be read in ahead of that.  After that, the
+	// merges and rotations all stream through memory in one direction or
+	// the other, which the default read-around already handles well.  We
+	// don't use MADV_SEQUENTIAL as that would drop pages as soon as they've
+	// been passed over, and every pass of the sort would read them in again
+	madvise(a, st.st_size, MADV_WILLNEED);
+
+	forsort_stable(a, st.st_size / es, es, is_lt);
+
+	if (munmap(a, st.st_size) < 0)
+		goto inplace_done;
+
+	ret = 0;
+
+inplace_done:
+	err = errno;
+	close(fd);
+	errno = err;
+	return ret;
+} // forsort_file_inplace
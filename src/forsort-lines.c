@@ -0,0 +1,422 @@
+//				FORSORT
+//
+// Author: Stew Forster (stew675@gmail.com)	Copyright (C) 2021-2025
+//
+// forsort-lines - Sorts the lines of a text file, in the manner of sort(1)
+//
+// The file is mapped into memory and never copied.  Instead an array of 16
+// byte (offset, length) descriptors is built, one per line, and that is what
+// gets sorted with forsort_stable().  As forsort_stable() needs no work-space
+// the only memory used beyond the mapping itself, which the kernel can always
+// page back out to the file, is the descriptor array.  The sorted lines are
+// then written straight out of the mapping with writev().
+//
+// The sort is stable, so lines with equal keys stay in the order that they
+// were given in.  Keys are compared byte by byte, as sort(1) does when run
+// with LC_ALL=C, or as numbers with -n.
+
+#define _GNU_SOURCE
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "forsort.h"
+
+#ifndef IOV_MAX
+#define	IOV_MAX		1024
+#endif
+
+struct line {
+	size_t	off;		// Byte offset of the line within text
+	size_t	len;		// Length of the line, without its newline
+};
+
+static	const char	*text = NULL;
+static	size_t		text_size = 0;
+
+// Key options.  Fields are numbered from 1, and a last_field of 0 means that
+// the key runs on to the end of the line
+static	size_t	first_field = 0;
+static	size_t	last_field = 0;
+static	int	separator = -1;
+static	bool	numeric = false;
+
+
+static inline bool
+is_blank(char c)
+{
+	return (c == ' ') || (c == '\t');
+} // is_blank
+
+
+// Returns the start of field FIELD, which begins at position P.  Without a
+// separator, fields are runs of non-blanks, and the blanks ahead of each are
+// skipped over
+static const char *
+field_start(const char *p, const char *e, size_t field)
+{
+	if (separator >= 0) {
+		while (--field > 0) {
+			const char *s = memchr(p, separator, e - p);
+
+			if (s == NULL)
+				return e;
+			p = s + 1;
+		}
+		return p;
+	}
+
+	for (;;) {
+		while ((p < e) && is_blank(*p))
+			p++;
+		if (--field == 0)
+			return p;
+		while ((p < e) && !is_blank(*p))
+			p++;
+	}
+} // field_start
+
+
+// Returns the end of the field that starts at P
+static const char *
+field_end(const char *p, const char *e)
+{
+	if (separator >= 0) {
+		const char *s = memchr(p, separator, e - p);
+
+		return s ? s : e;
+	}
+
+	while ((p < e) && !is_blank(*p))
+		p++;
+	return p;
+} // field_end
+
+
+// Sets *KS and *KE to the span of the key within line L
+static inline void
+line_key(const struct line *l, const char **ks, const char **ke)
+{
+	const char *p = text + l->off, *e = p + l->len;
+
+	if (first_field == 0) {
+		*ks = p;
+		*ke = e;
+		return;
+	}
+
+	p = field_start(p, e, first_field);
+	*ks = p;
+	*ke = last_field ? field_end(field_start(p, e, last_field - first_field + 1), e) : e;
+} // line_key
+
+
+// Reads a number in the form [-]digits[.digits] from the start of the key,
+// after skipping any leading blanks.  Anything that isn't a number reads as 0
+static double
+key_number(const char *p, const char *e)
+{
+	double	val = 0, scale = 1;
+	bool	neg = false;
+
+	while ((p < e) && is_blank(*p))
+		p++;
+
+	if ((p < e) && (*p == '-')) {
+		neg = true;
+		p++;
+	}
+
+	for (; (p < e) && (*p >= '0') && (*p <= '9'); p++)
+		val = val * 10 + (*p - '0');
+
+	if ((p < e) && (*p == '.'))
+		for (p++; (p < e) && (*p >= '0') && (*p <= '9'); p++)
+			val += (*p - '0') * (scale /= 10);
+
+	return neg ? -val : val;
+} // key_number
+
+
+static int
+is_lt_line(const void *p1, const void *p2)
+{
+	const char *s1, *e1, *s2, *e2;
+
+	line_key(p1, &s1, &e1);
+	line_key(p2, &s2, &e2);
+
+	if (numeric)
+		return key_number(s1, e1) < key_number(s2, e2);
+
+	size_t	l1 = e1 - s1, l2 = e2 - s2;
+	int	res = memcmp(s1, s2, (l1 < l2) ? l1 : l2);
+
+	return (res < 0) || ((res == 0) && (l1 < l2));
+} // is_lt_line
+
+
+static int
+is_gt_line(const void *p1, const void *p2)
+{
+	return is_lt_line(p2, p1);
+} // is_gt_line
+
+
+// Reads all of FD into a buffer that grows as needed, for input that can't be
+// mapped such as a pipe.  Returns NULL on an error
+static char *
+read_all(int fd, size_t *size)
+{
+	size_t	len = 0, cap = 1 << 20;
+	char	*buf = malloc(cap);
+
+	while (buf) {
+		if (len == cap) {
+			char	*nbuf = realloc(buf, cap *= 2);
+
+			if (nbuf == NULL)
+				break;
+			buf = nbuf;
+		}
+
+		ssize_t	res = read(fd, buf + len, cap - len);
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			break;
+		}
+		if (res == 0) {
+			*size = len;
+			return buf;
+		}
+		len += res;
+	}
+
+	free(buf);
+	return NULL;
+} // read_all
+
+
+// Writes out all of the CNT buffers in IOV, carrying on after short writes.
+// Returns 0 on success, or -1 on an error
+static int
+writev_full(int fd, struct iovec *iov, int cnt)
+{
+	while (cnt > 0) {
+		ssize_t	res = writev(fd, iov, cnt);
+
+		if (res < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+
+		for (; (cnt > 0) && ((size_t)res >= iov->iov_len); iov++, cnt--)
+			res -= iov->iov_len;
+		if (cnt > 0) {
+			iov->iov_base = (char *)iov->iov_base + res;
+			iov->iov_len -= res;
+		}
+	}
+	return 0;
+} // writev_full
+
+
+// Writes the lines out in their sorted order.  Lines that were next to each
+// other in the input and still are, go out as one buffer
+static int
+write_lines(int fd, const struct line *lines, size_t n)
+{
+	static	char	newline = '\n';
+	struct	iovec	iov[IOV_MAX];
+	int	cnt = 0;
+
+	for (const struct line *l = lines, *le = lines + n; l < le; l++) {
+		const char *p = text + l->off;
+		size_t	len = l->len;
+
+		// Every line but possibly the last one still has its newline
+		if ((l->off + len) < text_size)
+			len++;
+
+		if ((cnt > 0) && ((char *)iov[cnt - 1].iov_base + iov[cnt - 1].iov_len == p)) {
+			iov[cnt - 1].iov_len += len;
+		} else {
+			if (cnt == IOV_MAX) {
+				if (writev_full(fd, iov, cnt) < 0)
+					return -1;
+				cnt = 0;
+			}
+			iov[cnt].iov_base = (void *)p;
+			iov[cnt++].iov_len = len;
+		}
+
+		if (len == l->len) {
+			if (cnt == IOV_MAX) {
+				if (writev_full(fd, iov, cnt) < 0)
+					return -1;
+				cnt = 0;
+			}
+			iov[cnt].iov_base = &newline;
+			iov[cnt++].iov_len = 1;
+		}
+	}
+
+	return writev_full(fd, iov, cnt);
+} // write_lines
+
+
+static void
+usage(char *prog, const char *msg)
+{
+	if (msg)
+		fprintf(stderr, "\nError: %s\n", msg);
+	fprintf(stderr, "\nUsage: %s [options] [<input>]\n", prog);
+	fprintf(stderr, "\nSorts the lines of a text file, and writes them to standard output.  The sort\n");
+	fprintf(stderr, "is stable, and keys are compared byte by byte.  If <input> is - or is not given,\n");
+	fprintf(stderr, "lines are read from standard input\n\n");
+	fprintf(stderr, "[options] are zero or more of the following options\n");
+	fprintf(stderr, "  -k <F>[,<L>]      Sort on fields F through L (default=the whole line)\n");
+	fprintf(stderr, "                    Without L, the key runs to the end of the line\n");
+	fprintf(stderr, "  -t <c>            Fields are separated by the character c.  Without -t,\n");
+	fprintf(stderr, "                    fields are separated by blanks, which are skipped\n");
+	fprintf(stderr, "  -n                Compare keys as numbers\n");
+	fprintf(stderr, "  -r                Sort into descending order\n");
+	fprintf(stderr, "  -o <out>          File to write the sorted lines to.  It may be the input\n");
+	exit(-1);
+} // usage
+
+
+int
+main(int argc, char *argv[])
+{
+	const char	*input = "-", *output = NULL;
+	struct stat	ist, ost;
+	bool		reverse = false, mapped = false;
+	int		opt, fd = STDIN_FILENO, out_fd = STDOUT_FILENO;
+	char		*end;
+
+	while ((opt = getopt(argc, argv, "k:t:nro:h")) != -1) {
+		switch (opt) {
+		case 'k':
+			first_field = strtoull(optarg, &end, 10);
+			if (*end == ',')
+				last_field = strtoull(end + 1, &end, 10);
+			if ((first_field == 0) || (*end != '\0') ||
+			    (last_field && (last_field < first_field)))
+				usage(argv[0], "Bad key field specification");
+			break;
+		case 't':
+			if ((optarg[0] == '\0') || (optarg[1] != '\0'))
+				usage(argv[0], "The separator must be a single character");
+			separator = (unsigned char)optarg[0];
+			break;
+		case 'n':
+			numeric = true;
+			break;
+		case 'r':
+			reverse = true;
+			break;
+		case 'o':
+			output = optarg;
+			break;
+		case 'h':
+			usage(argv[0], NULL);
+			break;
+		default:
+			usage(argv[0], "Unsupported option");
+		}
+	}
+
+	if (optind < (argc - 1))
+		usage(argv[0], "Only one input file may be given");
+	if (optind < argc)
+		input = argv[optind];
+
+	if (strcmp(input, "-") && ((fd = open(input, O_RDONLY)) < 0))
+		goto lines_fail;
+
+	if (fstat(fd, &ist) < 0)
+		goto lines_fail;
+
+	// The output is truncated before anything is written to it, so if it's
+	// the input as well, then the input can't be left in a mapping of it
+	bool	same = output && (stat(output, &ost) == 0) &&
+		       (ost.st_dev == ist.st_dev) && (ost.st_ino == ist.st_ino);
+
+	if (S_ISREG(ist.st_mode) && !same) {
+		text_size = ist.st_size;
+		if (text_size > 0) {
+			text = mmap(NULL, text_size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (text == MAP_FAILED)
+				goto lines_fail;
+			madvise((void *)text, text_size, MADV_WILLNEED);
+			mapped = true;
+		}
+	} else if ((text = read_all(fd, &text_size)) == NULL) {
+		goto lines_fail;
+	}
+
+	// Count the lines first so that the descriptors are allocated just once
+	size_t	n = 0;
+
+	for (const char *p = text, *e = text + text_size; p < e; n++) {
+		const char *nl = memchr(p, '\n', e - p);
+
+		p = nl ? nl + 1 : e;
+	}
+
+	struct line *lines = malloc((n ? n : 1) * sizeof(*lines));
+
+	if (lines == NULL)
+		goto lines_fail;
+
+	size_t	i = 0;
+
+	for (const char *p = text, *e = text + text_size; p < e; i++) {
+		const char *nl = memchr(p, '\n', e - p);
+
+		lines[i].off = p - text;
+		lines[i].len = (nl ? nl : e) - p;
+		p = nl ? nl + 1 : e;
+	}
+
+	if (n > 1)
+		forsort_stable(lines, n, sizeof(*lines), reverse ? is_gt_line : is_lt_line);
+
+	if (output && strcmp(output, "-")) {
+		input = output;
+		if ((out_fd = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0644)) < 0)
+			goto lines_fail;
+	}
+
+	if ((write_lines(out_fd, lines, n) < 0) || (close(out_fd) < 0)) {
+		input = (output && strcmp(output, "-")) ? output : "standard output";
+		goto lines_fail;
+	}
+
+	free(lines);
+	if (mapped)
+		munmap((void *)text, text_size);
+	else
+		free((void *)text);
+	return 0;
+
+lines_fail:
+	fprintf(stderr, "%s: %s: %s\n", argv[0], strcmp(input, "-") ? input : "standard input",
+		strerror(errno));
+	return 1;
+} // main
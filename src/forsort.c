@@ -72,6 +72,8 @@
 // used as the scratch work-space to invoke the adaptive merge sort in place
 // algorithm to efficiently sort that which remains.
 
+#define _GNU_SOURCE
+
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
@@ -99,6 +101,12 @@
 // then this can be safely set to 0 to disable this feature entirely.
 #define	BASIC_BUF_SIZE		4096
 
+// ASYMMETRIC_RATIO is how many times larger one side of an in-place merge
+// must be than the other, before rotate_merge_in_place() will copy the small
+// side out to a BASIC_BUF_SIZE stack buffer and gallop it into place instead
+// of splitting it up and rotating.  Setting this to 0 disables that entirely
+#define	ASYMMETRIC_RATIO	16
+
 // BASIC_SKEW defines the split ratio when doing top-down division of the array
 // While rotate_merge_in_place() will merge any two sorted arrays together in
 // linear O(M+N) time, experimentally there is an observable performance bias
@@ -124,12 +132,59 @@
 // Experimentally 29 appears to be the optimal value here
 #define	STABLE_WSRATIO		29
 
+// STABLE_LOW_CARDINALITY is the most distinct keys that the stable sorting
+// front end can find in its first sample before it'll give up on digging out
+// uniques, and just bucket the input by key instead.  Each item then gets
+// moved about O(logK) times, for K distinct keys
+#define	STABLE_LOW_CARDINALITY	256
+
 // Set the following to 1 to enable low-stack mode, whereby we will not use
 // shift_merge_in_place(), and ONLY use split_merge_in_place algorithm.  This
 // will also use the bottom up merge implementation.  An average this is about
 // a 4% speed penalty, which admittedly isn't a whole lot
 #define	LOW_STACK		0
 
+// PARALLEL_ROTATE_MIN is the size in bytes that any single block exchange
+// within rotate_block() must reach before it is split up across multiple
+// threads.  Thread start-up costs are only repaid on very large rotations,
+// such as those in the final merges of 100M+ item sorts.  Setting this to 0
+// disables multi-threaded block exchanges entirely
+#define	PARALLEL_ROTATE_MIN	(16 << 20)
+
+// PARALLEL_SLICE_MIN is the smallest amount of work, in bytes, that is worth
+// handing to any one thread when splitting up work across multiple threads
+#define	PARALLEL_SLICE_MIN	(4 << 20)
+
+// MAX_THREADS caps the number of threads that ForSort will use at any one time
+#define	MAX_THREADS		64
+
+// PARALLEL_SCAN_MIN is the size of input, in bytes, from which forsort_basic()
+// and forsort_stable() will use multiple threads to check if the input is
+// already sorted (or reversed) before doing anything else
+#define	PARALLEL_SCAN_MIN	(8 << 20)
+
+// PARALLEL_SORT_MIN is the smallest amount of data, in bytes, that it's worth
+// giving to any one thread to sort with forsort_parallel().  It is also the
+// smallest merge that forsort_parallel() will split up between threads
+#define	PARALLEL_SORT_MIN	(1 << 20)
+
+// Set NUMA_AWARE to 1 to have forsort_parallel() pin its threads to the nodes
+// that own the chunks of the array that they're sorting, and to allocate their
+// work-spaces from node-local memory.  It makes no difference on single-node
+// machines.  Set NUMA_MIGRATE to 1 to also have each chunk moved across to the
+// memory of the node that's sorting it, if it doesn't already live there
+#define	NUMA_AWARE		1
+#define	NUMA_MIGRATE		1
+
+// The most NUMA nodes that we'll keep track of
+#define	MAX_NUMA_NODES		64
+
+// HUGE_ALLOC_MIN is the size in bytes from which the work-spaces that ForSort
+// allocates for itself are mapped with huge pages, where the system has them.
+// This is aimed at TLB misses across 100M+ item work-spaces, but that hasn't
+// been measured yet.  Setting this to 0 always uses plain malloc()
+#define	HUGE_ALLOC_MIN		(4 << 20)
+
 
 //-----------------------------------------------------------------------------
 //                           Generic Defines
@@ -164,6 +219,12 @@ enum {
 	LEAP_RIGHT,
 };
 
+enum {
+	ORDER_MIXED = 0,
+	ORDER_ASCENDING,
+	ORDER_DESCENDING,
+};
+
 // Flip between the two to enable/disable assert()'s, but leaving them
 // on does not appear to impact performance in any significant manner
 #if 1
@@ -311,6 +372,78 @@ ceil_log_base_16(size_t n)
 
 #pragma GCC diagnostic pop
 
+#include "forsort-thread.h"
+
+//---------------------------------------------------------------------------//
+//                             Sort Contexts
+//---------------------------------------------------------------------------//
+
+// A sort context holds onto everything that is otherwise set up and torn down
+// on every single call.  Its work-spaces only ever grow, so a caller that sorts
+// many arrays of a similar size pays for allocating them only once
+struct forsort_ctx {
+	struct parallel_pool	pool;
+	size_t			wsratio;		// Tunables
+	size_t			max_workspace;
+	void			*ws[MAX_THREADS];	// Per-task work-spaces
+	size_t			wsize[MAX_THREADS];	// Size of each in bytes
+	size_t			wnode[MAX_THREADS];	// Node each is local to
+	const struct numa_topology *wtopo[MAX_THREADS];
+};
+
+// Returns the work-space size, in bytes, to use when sorting N items
+static size_t
+ctx_workspace_size(const struct forsort_ctx *ctx, size_t n, size_t es)
+{
+	size_t	size;
+
+	if (ctx == NULL)
+		return (n / WSRATIO) * es;
+
+	size = (n / ctx->wsratio) * es;
+	if (ctx->max_workspace && (size > ctx->max_workspace))
+		size = (ctx->max_workspace / es) * es;
+	return size;
+} // ctx_workspace_size
+
+
+// Returns a work-space of at least SIZE bytes for task INDEX to use, local to
+// NODE when TOPO is given, or NULL if one couldn't be allocated.  Without a
+// context this is simply a fresh allocation
+static void *
+ctx_workspace_get(struct forsort_ctx *ctx, size_t index, size_t size,
+		  const struct numa_topology *topo, size_t node)
+{
+	if (size == 0)
+		return NULL;
+
+	if (ctx == NULL)
+		return node_alloc_local(topo, size, node);
+
+	if (ctx->ws[index] && (ctx->wsize[index] >= size) &&
+	    (ctx->wtopo[index] == topo) && (!topo || (ctx->wnode[index] == node)))
+		return ctx->ws[index];
+
+	if (ctx->ws[index])
+		node_free_local(ctx->wtopo[index], ctx->ws[index], ctx->wsize[index]);
+
+	ctx->ws[index] = node_alloc_local(topo, size, node);
+	ctx->wsize[index] = ctx->ws[index] ? size : 0;
+	ctx->wnode[index] = node;
+	ctx->wtopo[index] = topo;
+	return ctx->ws[index];
+} // ctx_workspace_get
+
+
+// Hands back a work-space from ctx_workspace_get().  A context keeps it
+static void
+ctx_workspace_put(struct forsort_ctx *ctx, void *ws, size_t size,
+		  const struct numa_topology *topo)
+{
+	if ((ctx == NULL) && (ws != NULL))
+		node_free_local(topo, ws, size);
+} // ctx_workspace_put
+
 //---------------------------------------------------------------------------//
 //                         Specific Typed Includes
 //---------------------------------------------------------------------------//
@@ -324,6 +457,8 @@ ceil_log_base_16(size_t n)
 #include "forsort-basic.h"
 #include "forsort-merge.h"
 #include "forsort-stable.h"
+#include "forsort-parallel.h"
+#include "forsort-select.h"
 #undef VAR
 
 #define	VAR uint64_t
@@ -332,6 +467,8 @@ ceil_log_base_16(size_t n)
 #include "forsort-basic.h"
 #include "forsort-merge.h"
 #include "forsort-stable.h"
+#include "forsort-parallel.h"
+#include "forsort-select.h"
 #undef VAR
 
 #define	VAR uint32_t
@@ -340,6 +477,8 @@ ceil_log_base_16(size_t n)
 #include "forsort-basic.h"
 #include "forsort-merge.h"
 #include "forsort-stable.h"
+#include "forsort-parallel.h"
+#include "forsort-select.h"
 #undef VAR
 
 #undef NITEM
@@ -358,6 +497,8 @@ ceil_log_base_16(size_t n)
 #include "forsort-basic.h"
 #include "forsort-merge.h"
 #include "forsort-stable.h"
+#include "forsort-parallel.h"
+#include "forsort-select.h"
 #undef UNTYPED
 #undef VAR
 #undef NITEM
@@ -438,7 +579,7 @@ forsort_inplace(void *a, const size_t n, const size_t es,
 	if (dynamic) {
 		// Allocate a workspace that is 1/WSRATIO of the total array size
 		worksize = (n * es) / WSRATIO;
-		workspace = malloc(worksize);
+		workspace = huge_alloc(worksize);
 	}
 
 	if (swaptype == SWAP_WORDS_64) {
@@ -452,6 +593,714 @@ forsort_inplace(void *a, const size_t n, const size_t es,
 	}
 
 	if (dynamic && (workspace != NULL))
-		free(workspace);
+		huge_free(workspace, worksize);
 } // forsort_inplace
 
+
+
+static void
+parallel_sort_dispatch(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *), size_t nthreads,
+	struct forsort_ctx *ctx)
+{
+	int     swaptype = get_swap_type(a, es);
+
+	if (swaptype == SWAP_WORDS_64) {
+		parallel_sort_uint64_t((uint64_t *)a, n, nthreads, ctx, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		parallel_sort_uint32_t((uint32_t *)a, n, nthreads, ctx, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		parallel_sort_uint128_t((uint128_t *)a, n, nthreads, ctx, COMMON_ARGS);
+	} else {
+		parallel_sort_char((char *)a, n, nthreads, ctx, COMMON_ARGS);
+	}
+} // parallel_sort_dispatch
+
+
+void
+forsort_parallel(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *), size_t nthreads)
+{
+	parallel_sort_dispatch(a, n, es, is_lt, nthreads, NULL);
+} // forsort_parallel
+
+
+size_t
+forsort_runs(const void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	size_t *offsets, size_t noffsets)
+{
+	int     swaptype = get_swap_type((void *)a, es);
+
+	if (swaptype == SWAP_WORDS_64) {
+		return find_runs_uint64_t((uint64_t *)a, n, offsets, noffsets, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		return find_runs_uint32_t((uint32_t *)a, n, offsets, noffsets, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		return find_runs_uint128_t((uint128_t *)a, n, offsets, noffsets, COMMON_ARGS);
+	} else {
+		return find_runs_char((char *)a, n, offsets, noffsets, COMMON_ARGS);
+	}
+} // forsort_runs
+
+
+static void
+batch_sort_dispatch(void * const *arrays, const size_t *counts, const size_t k,
+	const size_t es, int (*is_lt)(const void *, const void *),
+	struct forsort_ctx *ctx)
+{
+	uintptr_t	align = 0;
+
+	// All the arrays must share the same alignment to use a typed variant
+	for (size_t i = 0; i < k; i++)
+		align |= (uintptr_t)arrays[i];
+
+	int     swaptype = get_swap_type((void *)align, es);
+
+	if (swaptype == SWAP_WORDS_64) {
+		batch_sort_uint64_t((uint64_t * const *)arrays, counts, k, ctx, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		batch_sort_uint32_t((uint32_t * const *)arrays, counts, k, ctx, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		batch_sort_uint128_t((uint128_t * const *)arrays, counts, k, ctx, COMMON_ARGS);
+	} else {
+		batch_sort_char((char * const *)arrays, counts, k, ctx, COMMON_ARGS);
+	}
+} // batch_sort_dispatch
+
+
+void
+forsort_batch(void * const *arrays, const size_t *counts, const size_t k,
+	const size_t es, int (*is_lt)(const void *, const void *))
+{
+	batch_sort_dispatch(arrays, counts, k, es, is_lt, NULL);
+} // forsort_batch
+
+
+void
+forsort_partial(void *a, const size_t n, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize)
+{
+	int     swaptype = get_swap_type(a, es);
+	int	dynamic = 0;
+
+	if ((workspace == NULL) && (worksize == 1))
+		dynamic = 1;
+
+	if (dynamic) {
+		// Only the K items being kept are ever merged, so a work-space
+		// big enough to hold all of them is still only a small one
+		worksize = MIN(k, n / WSRATIO) * es;
+		workspace = huge_alloc(worksize);
+	}
+
+	if (swaptype == SWAP_WORDS_64) {
+		partial_sort_uint64_t((uint64_t *)a, n, k, (uint64_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		partial_sort_uint32_t((uint32_t *)a, n, k, (uint32_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		partial_sort_uint128_t((uint128_t *)a, n, k, (uint128_t *)workspace, worksize / es, COMMON_ARGS);
+	} else {
+		partial_sort_char((char *)a, n, k, (char *)workspace, worksize / es, COMMON_ARGS);
+	}
+
+	if (dynamic && (workspace != NULL))
+		huge_free(workspace, worksize);
+} // forsort_partial
+
+
+void
+forsort_select(void *a, const size_t n, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	int     swaptype = get_swap_type(a, es);
+
+	if (k >= n)
+		return;
+
+	if (swaptype == SWAP_WORDS_64) {
+		select_kth_uint64_t((uint64_t *)a, n, k, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		select_kth_uint32_t((uint32_t *)a, n, k, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		select_kth_uint128_t((uint128_t *)a, n, k, COMMON_ARGS);
+	} else {
+		select_kth_char((char *)a, n, k, COMMON_ARGS);
+	}
+} // forsort_select
+
+
+void
+forsort_select_stable(void *a, const size_t n, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize)
+{
+	int     swaptype = get_swap_type(a, es);
+	int	dynamic = 0;
+
+	if (k >= n)
+		return;
+
+	if ((workspace == NULL) && (worksize == 1))
+		dynamic = 1;
+
+	if (dynamic) {
+		// Allocate a workspace that is 1/WSRATIO of the total array size
+		worksize = (n * es) / WSRATIO;
+		workspace = huge_alloc(worksize);
+	}
+
+	if (workspace == NULL)
+		worksize = 0;
+
+	if (swaptype == SWAP_WORDS_64) {
+		stable_select_uint64_t((uint64_t *)a, n, k, (uint64_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		stable_select_uint32_t((uint32_t *)a, n, k, (uint32_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		stable_select_uint128_t((uint128_t *)a, n, k, (uint128_t *)workspace, worksize / es, COMMON_ARGS);
+	} else {
+		stable_select_char((char *)a, n, k, (char *)workspace, worksize / es, COMMON_ARGS);
+	}
+
+	if (dynamic && (workspace != NULL))
+		huge_free(workspace, worksize);
+} // forsort_select_stable
+
+
+void
+forsort_merge(void *a, const size_t na, const size_t nb, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize)
+{
+	int     swaptype = get_swap_type(a, es);
+	int	dynamic = 0;
+
+	if ((workspace == NULL) && (worksize == 1))
+		dynamic = 1;
+
+	if (dynamic) {
+		// A work-space that can hold the smaller run makes for a single
+		// linear pass, but don't go beyond 1/WSRATIO of the total size
+		worksize = MIN(MIN(na, nb), (na + nb) / WSRATIO) * es;
+		workspace = huge_alloc(worksize);
+	}
+
+	if (workspace == NULL)
+		worksize = 0;
+
+	if (swaptype == SWAP_WORDS_64) {
+		merge_adjacent_uint64_t((uint64_t *)a, na, nb, (uint64_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		merge_adjacent_uint32_t((uint32_t *)a, na, nb, (uint32_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		merge_adjacent_uint128_t((uint128_t *)a, na, nb, (uint128_t *)workspace, worksize / es, COMMON_ARGS);
+	} else {
+		merge_adjacent_char((char *)a, na, nb, (char *)workspace, worksize / es, COMMON_ARGS);
+	}
+
+	if (dynamic && (workspace != NULL))
+		huge_free(workspace, worksize);
+} // forsort_merge
+
+
+void
+forsort_kmerge(void *a, const size_t *offsets, const size_t k, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize)
+{
+	int     swaptype = get_swap_type(a, es);
+	int	dynamic = 0;
+
+	if (k < 2)
+		return;
+
+	if ((workspace == NULL) && (worksize == 1))
+		dynamic = 1;
+
+	if (dynamic) {
+		// Allocate a workspace that is 1/WSRATIO of the total array size
+		worksize = ((offsets[k] - offsets[0]) * es) / WSRATIO;
+		workspace = huge_alloc(worksize);
+	}
+
+	if (workspace == NULL)
+		worksize = 0;
+
+	if (swaptype == SWAP_WORDS_64) {
+		kmerge_uint64_t((uint64_t *)a, offsets, k, (uint64_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		kmerge_uint32_t((uint32_t *)a, offsets, k, (uint32_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		kmerge_uint128_t((uint128_t *)a, offsets, k, (uint128_t *)workspace, worksize / es, COMMON_ARGS);
+	} else {
+		kmerge_char((char *)a, offsets, k, (char *)workspace, worksize / es, COMMON_ARGS);
+	}
+
+	if (dynamic && (workspace != NULL))
+		huge_free(workspace, worksize);
+} // forsort_kmerge
+
+
+void
+forsort_append_sorted(void *a, const size_t n_sorted, const size_t n_new, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void *workspace, size_t worksize)
+{
+	int     swaptype = get_swap_type(a, es);
+	int	dynamic = 0;
+
+	if ((workspace == NULL) && (worksize == 1))
+		dynamic = 1;
+
+	if (dynamic) {
+		// Enough to hold all the new items is best for merging them in,
+		// but don't go beyond 1/WSRATIO of the total size.  Always have
+		// at least one item so that we stay sort-stable
+		worksize = MIN(n_new, ((n_sorted + n_new) / WSRATIO) + 1) * es;
+		workspace = huge_alloc(worksize);
+	}
+
+	if (workspace == NULL)
+		worksize = 0;
+
+	if (swaptype == SWAP_WORDS_64) {
+		append_sorted_uint64_t((uint64_t *)a, n_sorted, n_new, (uint64_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		append_sorted_uint32_t((uint32_t *)a, n_sorted, n_new, (uint32_t *)workspace, worksize / es, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		append_sorted_uint128_t((uint128_t *)a, n_sorted, n_new, (uint128_t *)workspace, worksize / es, COMMON_ARGS);
+	} else {
+		append_sorted_char((char *)a, n_sorted, n_new, (char *)workspace, worksize / es, COMMON_ARGS);
+	}
+
+	if (dynamic && (workspace != NULL))
+		huge_free(workspace, worksize);
+} // forsort_append_sorted
+
+
+static size_t
+unique_dispatch(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void (*combine)(void *, const void *))
+{
+	int     swaptype = get_swap_type(a, es);
+	size_t	worksize = (n * es) / WSRATIO, nu;
+	void	*workspace = huge_alloc(worksize);
+
+	// Without a work-space, sort_unique() falls back to stable_sort()
+	if (workspace == NULL)
+		worksize = 0;
+
+	if (swaptype == SWAP_WORDS_64) {
+		nu = sort_unique_uint64_t((uint64_t *)a, n, (uint64_t *)workspace, worksize / es, combine, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_32) {
+		nu = sort_unique_uint32_t((uint32_t *)a, n, (uint32_t *)workspace, worksize / es, combine, COMMON_ARGS);
+	} else if (swaptype == SWAP_WORDS_128) {
+		nu = sort_unique_uint128_t((uint128_t *)a, n, (uint128_t *)workspace, worksize / es, combine, COMMON_ARGS);
+	} else {
+		nu = sort_unique_char((char *)a, n, (char *)workspace, worksize / es, combine, COMMON_ARGS);
+	}
+
+	if (workspace != NULL)
+		huge_free(workspace, worksize);
+
+	return nu;
+} // unique_dispatch
+
+
+size_t
+forsort_unique(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	return unique_dispatch(a, n, es, is_lt, NULL);
+} // forsort_unique
+
+
+size_t
+forsort_reduce(void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *),
+	void (*combine)(void *, const void *))
+{
+	return unique_dispatch(a, n, es, is_lt, combine);
+} // forsort_reduce
+
+
+// stable_partition() hands its test the item and an argument, so the caller's
+// single argument predicate is carried through in one of these
+struct partition_pred {
+	int	(*pred)(const void *);
+};
+
+static int
+partition_test(const void *item, const void *arg)
+{
+	return ((const struct partition_pred *)arg)->pred(item);
+} // partition_test
+
+
+size_t
+forsort_stable_partition(void *a, const size_t n, const size_t es,
+	int (*pred)(const void *),
+	void *workspace, size_t worksize)
+{
+	int     swaptype = get_swap_type(a, es);
+	int	dynamic = 0;
+	size_t	np;
+	struct partition_pred arg = {pred};
+	_Alignas(64) char buf[BASIC_BUF_SIZE];
+
+	if ((workspace == NULL) && (worksize == 1))
+		dynamic = 1;
+
+	if (dynamic) {
+		// Allocate a workspace that is 1/WSRATIO of the total array size
+		worksize = (n * es) / WSRATIO;
+		workspace = huge_alloc(worksize);
+	}
+
+	if (workspace == NULL)
+		worksize = 0;
+
+	// Anything smaller than the stack buffer would only add more rotations
+	if (worksize < sizeof(buf)) {
+		if (dynamic && (workspace != NULL))
+			huge_free(workspace, worksize);
+		dynamic = 0;
+		workspace = buf;
+		worksize = sizeof(buf);
+	}
+
+	if (swaptype == SWAP_WORDS_64) {
+		np = stable_partition_uint64_t((uint64_t *)a, n, partition_test, &arg, (uint64_t *)workspace, worksize / es, es);
+	} else if (swaptype == SWAP_WORDS_32) {
+		np = stable_partition_uint32_t((uint32_t *)a, n, partition_test, &arg, (uint32_t *)workspace, worksize / es, es);
+	} else if (swaptype == SWAP_WORDS_128) {
+		np = stable_partition_uint128_t((uint128_t *)a, n, partition_test, &arg, (uint128_t *)workspace, worksize / es, es);
+	} else {
+		np = stable_partition_char((char *)a, n, partition_test, &arg, (char *)workspace, worksize / es, es);
+	}
+
+	if (dynamic)
+		huge_free(workspace, worksize);
+
+	return np;
+} // forsort_stable_partition
+
+
+// forsort_prefix() sorts an array of these in place of the caller's array of
+// pointers.  Each one is 16 bytes, and so is sorted by the uint128_t typed
+// sort.  Ties between prefixes are handed to the caller's comparator, which is
+// kept aside for the calling thread in prefix_is_lt
+struct prefix_entry {
+	uint64_t	prefix;
+	void		*item;
+};
+
+static _Thread_local int (*prefix_is_lt)(const void *, const void *) = NULL;
+
+static int
+prefix_entry_lt(const void *p1, const void *p2)
+{
+	const struct prefix_entry *e1 = p1, *e2 = p2;
+
+	if (e1->prefix != e2->prefix)
+		return e1->prefix < e2->prefix;
+
+	// The caller's comparator expects pointers to the slots in its array
+	// of pointers, and &item is just that
+	return prefix_is_lt(&e1->item, &e2->item);
+} // prefix_entry_lt
+
+
+void
+forsort_prefix(void **a, const size_t n, uint64_t (*prefix)(const void *),
+	int (*is_lt)(const void *, const void *))
+{
+	const size_t	es = sizeof(struct prefix_entry);
+	size_t		worksize = (n * es) / WSRATIO;
+	size_t		size = (n * es) + worksize;
+	struct prefix_entry *pe;
+
+	if (n < 2)
+		return;
+
+	// Without room for the entries, sort the pointers as they are
+	if ((pe = huge_alloc(size)) == NULL) {
+		forsort_stable(a, n, sizeof(*a), is_lt);
+		return;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		pe[i].prefix = prefix(a[i]);
+		pe[i].item = a[i];
+	}
+
+	// prefix_is_lt is only set for this thread, so don't let any part of
+	// the sort go out to other threads.  Both are restored afterwards in
+	// case we've been called from within another caller's comparator
+	int	(*prev_is_lt)(const void *, const void *) = prefix_is_lt;
+	bool	nested = in_parallel_task;
+
+	prefix_is_lt = is_lt;
+	in_parallel_task = true;
+
+	forsort_inplace(pe, n, es, prefix_entry_lt, pe + n, worksize);
+
+	in_parallel_task = nested;
+	prefix_is_lt = prev_is_lt;
+
+	for (size_t i = 0; i < n; i++)
+		a[i] = pe[i].item;
+
+	huge_free(pe, size);
+} // forsort_prefix
+
+
+// The first 8 bytes of a string as a big-endian number, padded out with NULs.
+// Shorter strings and smaller bytes give smaller numbers, just as in strcmp()
+static uint64_t
+string_prefix(const void *item)
+{
+	const unsigned char *s = item;
+	uint64_t	p = 0;
+
+	for (int i = 0; i < 8; i++) {
+		p <<= 8;
+		if (*s)
+			p |= *s++;
+	}
+	return p;
+} // string_prefix
+
+
+static int
+string_is_lt(const void *p1, const void *p2)
+{
+	return strcmp(*(char * const *)p1, *(char * const *)p2) < 0;
+} // string_is_lt
+
+
+void
+forsort_strings(char **a, const size_t n)
+{
+	forsort_prefix((void **)a, n, string_prefix, string_is_lt);
+} // forsort_strings
+
+
+// Copies the N ES sized items of SRC into DST in the order given by PERM.
+// The common sizes get a fixed size memcpy() that compiles to a single move
+static void
+permute_gather(char * restrict dst, const char * restrict src,
+	const size_t *perm, const size_t n, const size_t es)
+{
+	switch (es) {
+	case 1:
+		for (size_t i = 0; i < n; i++)
+			dst[i] = src[perm[i]];
+		break;
+	case 2:
+		for (size_t i = 0; i < n; i++)
+			memcpy(dst + (i * 2), src + (perm[i] * 2), 2);
+		break;
+	case 4:
+		for (size_t i = 0; i < n; i++)
+			memcpy(dst + (i * 4), src + (perm[i] * 4), 4);
+		break;
+	case 8:
+		for (size_t i = 0; i < n; i++)
+			memcpy(dst + (i * 8), src + (perm[i] * 8), 8);
+		break;
+	default:
+		for (size_t i = 0; i < n; i++)
+			memcpy(dst + (i * es), src + (perm[i] * es), es);
+		break;
+	}
+} // permute_gather
+
+
+// Sorts KEYS, and reorders each of the M PAYLOADS the same way.  Each key is
+// copied into a row along with its index, with the key first so that is_lt
+// can be handed the rows as they are.  Rows with keys of up to 8 bytes are
+// 16 bytes and so take the uint128_t typed path.  The rows are sorted with a
+// work-space, which keeps it stable, and the sorted keys are copied back out.
+// The indices are then packed down to the front of the same buffer, and what
+// is left over becomes the space that each payload is gathered into
+int
+forsort_cosort(void *keys, const size_t n, const size_t key_es,
+	int (*is_lt)(const void *, const void *),
+	void * const *payloads, const size_t *payload_es, const size_t m)
+{
+	const size_t	rs = ((key_es + 7) & ~(size_t)7) + sizeof(size_t);
+	size_t		worksize = (n * rs) / WSRATIO, max_es = 0, size;
+	char		*rows;
+
+	if (key_es == 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (n < 2)
+		return 0;
+
+	for (size_t j = 0; j < m; j++)
+		if (payload_es[j] > max_es)
+			max_es = payload_es[j];
+
+	size = (n * rs) + worksize;
+	if (size < (n * (sizeof(size_t) + max_es)))
+		size = n * (sizeof(size_t) + max_es);
+
+	if ((rows = huge_alloc(size)) == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		memcpy(rows + (i * rs), (char *)keys + (i * key_es), key_es);
+		memcpy(rows + (i * rs) + rs - sizeof(size_t), &i, sizeof(size_t));
+	}
+
+	forsort_inplace(rows, n, rs, is_lt, rows + (n * rs), worksize);
+
+	// Each index is packed down to no further along than where it was
+	// read from, so nothing is overwritten before it has been read
+	size_t	*perm = (size_t *)rows;
+
+	for (size_t i = 0; i < n; i++) {
+		memcpy((char *)keys + (i * key_es), rows + (i * rs), key_es);
+		memcpy(perm + i, rows + (i * rs) + rs - sizeof(size_t), sizeof(size_t));
+	}
+
+	char	*tmp = (char *)(perm + n);
+
+	for (size_t j = 0; j < m; j++) {
+		permute_gather(tmp, payloads[j], perm, n, payload_es[j]);
+		memcpy(payloads[j], tmp, n * payload_es[j]);
+	}
+
+	huge_free(rows, size);
+	return 0;
+} // forsort_cosort
+
+
+forsort_ctx_t *
+forsort_ctx_create(const forsort_opts_t *opts)
+{
+	struct forsort_ctx *ctx = calloc(1, sizeof(*ctx));
+	size_t	nthreads = opts ? opts->nthreads : 0;
+
+	if (ctx == NULL)
+		return NULL;
+
+	if ((nthreads == 0) || (nthreads > parallel_threads()))
+		nthreads = parallel_threads();
+
+	if (nthreads > MAX_THREADS)
+		nthreads = MAX_THREADS;
+
+	ctx->wsratio = (opts && opts->wsratio) ? opts->wsratio : WSRATIO;
+	ctx->max_workspace = opts ? opts->max_workspace : 0;
+
+	if (!pool_init(&ctx->pool, nthreads)) {
+		free(ctx);
+		return NULL;
+	}
+	return ctx;
+} // forsort_ctx_create
+
+
+void
+forsort_ctx_destroy(forsort_ctx_t *ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	pool_destroy(&ctx->pool);
+
+	for (size_t i = 0; i < MAX_THREADS; i++)
+		if (ctx->ws[i])
+			node_free_local(ctx->wtopo[i], ctx->ws[i], ctx->wsize[i]);
+	free(ctx);
+} // forsort_ctx_destroy
+
+
+// Makes the context's thread pool the one that this thread uses until the
+// matching ctx_leave().  Returns whichever pool was active beforehand
+static struct parallel_pool *
+ctx_enter(forsort_ctx_t *ctx)
+{
+	struct parallel_pool *prev = active_pool;
+
+	if (ctx != NULL)
+		active_pool = &ctx->pool;
+	return prev;
+} // ctx_enter
+
+
+static void
+ctx_leave(struct parallel_pool *prev)
+{
+	active_pool = prev;
+} // ctx_leave
+
+
+void
+forsort_basic_ctx(forsort_ctx_t *ctx, void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	struct parallel_pool *prev = ctx_enter(ctx);
+
+	forsort_basic(a, n, es, is_lt);
+	ctx_leave(prev);
+} // forsort_basic_ctx
+
+
+void
+forsort_stable_ctx(forsort_ctx_t *ctx, void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	struct parallel_pool *prev = ctx_enter(ctx);
+
+	forsort_stable(a, n, es, is_lt);
+	ctx_leave(prev);
+} // forsort_stable_ctx
+
+
+// The equivalent of forsort_inplace() with a NULL workspace and a worksize of
+// 1, except that the work-space is kept in the context for the next call
+void
+forsort_inplace_ctx(forsort_ctx_t *ctx, void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	struct parallel_pool *prev = ctx_enter(ctx);
+	size_t	worksize = ctx_workspace_size(ctx, n, es);
+	void	*workspace = ctx_workspace_get(ctx, 0, worksize, NULL, 0);
+
+	forsort_inplace(a, n, es, is_lt, workspace, workspace ? worksize : 0);
+	ctx_workspace_put(ctx, workspace, worksize, NULL);
+	ctx_leave(prev);
+} // forsort_inplace_ctx
+
+
+void
+forsort_parallel_ctx(forsort_ctx_t *ctx, void *a, const size_t n, const size_t es,
+	int (*is_lt)(const void *, const void *))
+{
+	struct parallel_pool *prev = ctx_enter(ctx);
+
+	parallel_sort_dispatch(a, n, es, is_lt, 0, ctx);
+	ctx_leave(prev);
+} // forsort_parallel_ctx
+
+
+void
+forsort_batch_ctx(forsort_ctx_t *ctx, void * const *arrays, const size_t *counts,
+	const size_t k, const size_t es, int (*is_lt)(const void *, const void *))
+{
+	struct parallel_pool *prev = ctx_enter(ctx);
+
+	batch_sort_dispatch(arrays, counts, k, es, is_lt, ctx);
+	ctx_leave(prev);
+} // forsort_batch_ctx
@@ -6,6 +6,10 @@
 #include <unistd.h>
 #include <ctype.h>
 #include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "timsort.h"
 
 #define DATA_SET_REVERSED	0x04
@@ -28,6 +32,9 @@ static	bool	stable = true;
 	size_t	numcmps = 0;
 static	size_t	worksize = 0;
 static	bool	supports_workspace = false;
+static	const char	*load_path = NULL;
+static	const char	*save_path = NULL;
+static	bool	huge_pages = false;
 
 struct item {
 	uint32_t	value;
@@ -43,6 +50,7 @@ struct item {
 } __attribute__((packed));
 
 #include "forsort.h"
+#include "forsort-huge.h"
 
 extern void grailSortInPlace(void *a, const size_t n, const size_t es,
 	int (*cmp)(const void *, const void *));
@@ -71,6 +79,8 @@ enum {
 	FORSORT_BASIC,
 	FORSORT_STABLE,
 	FORSORT_WORKSPACE,
+	FORSORT_PARALLEL,
+	FORSORT_CONTEXT,
 	SORT_UNKNOWN
 };
 
@@ -174,15 +184,20 @@ usage(char *prog, const char *msg)
 {
 	fprintf(stderr, "\nError: %s\n", msg);
 	fprintf(stderr, "\nUsage: %s [options] <sorttype> <num>\n", prog);
-	fprintf(stderr, "\n<num> is number of items you want sorted\n\n");
+	fprintf(stderr, "\n<num> is number of items you want sorted\n");
+	fprintf(stderr, "<num> may be left out with -i, in which case all of the file is sorted\n\n");
 	fprintf(stderr, "[options] are zero or more of the following options\n");
 	fprintf(stderr, "  -a seed       A random number generator seed value to use (default=1)\n");
 	fprintf(stderr, "                A value of 0 will use a randomly generated seed\n");
 	fprintf(stderr, "  -d <0..100>   Disorder the generated set by the percentage given (default=100)\n");
 	fprintf(stderr, "  -f            Data set keys/values range from 0..UINT32_MAX (default)\n");
+	fprintf(stderr, "  -H            Back the data set with huge pages (hugetlb if reserved, otherwise THP)\n");
+	fprintf(stderr, "  -i <file>     Load the data set from a binary file of items, instead of generating it\n");
+	fprintf(stderr, "                Every run sorts an identical copy of it\n");
 	fprintf(stderr, "  -l <num>      Data set keys/values limited in range from 0..(num-1)\n");
 	fprintf(stderr, "  -l n          If the letter 'n' is specified, use the number of elements as the key range\n");
 	fprintf(stderr, "  -o            Use a fully ordered data set (Shorthand for setting disorder factor to 0)\n");
+	fprintf(stderr, "  -O <file>     Save the first data set to a binary file of items, for use with -i\n");
 	fprintf(stderr, "  -r            Reverse the data set order after generating it\n");
 	fprintf(stderr, "  -u            Data set keys/values must all be unique\n");
 	fprintf(stderr, "  -v            Verbose.  Display the data set before sorting it\n");
@@ -195,6 +210,8 @@ usage(char *prog, const char *msg)
 	fprintf(stderr, "   fi   - Adaptive Forsort In-Place                    (Unstable)\n");
 	fprintf(stderr, "   fs   - Stable Forsort In-Place                      (Stable)\n");
 	fprintf(stderr, "   fw   - Forsort plus 1/8th Pre-Allocated Workspace   (Stable)\n");
+	fprintf(stderr, "   fp   - Parallel Forsort using all CPUs              (Stable)\n");
+	fprintf(stderr, "   fc   - Forsort re-using a Sort Context across runs  (Stable)\n");
 	fprintf(stderr, "   is   - Insertion Sort                               (Stable)\n");
 	fprintf(stderr, "   gs   - Grail Sort In-Place                          (Stable)\n");
 	fprintf(stderr, "   gq   - GLibc Quick Sort In-Place                    (Stability Not Guaranteed)\n");
@@ -279,6 +296,18 @@ parse_sort_type(char *opt)
 		return;
 	}
 
+	if (strcmp(opt, "fp") == 0) {
+		sortname = "Parallel Forsort";
+		sorttype =  FORSORT_PARALLEL;
+		return;
+	}
+
+	if (strcmp(opt, "fc") == 0) {
+		sortname = "Forsort With Sort Context";
+		sorttype =  FORSORT_CONTEXT;
+		return;
+	}
+
 	sorttype = SORT_UNKNOWN;
 	return;
 } // parse_sort_type
@@ -329,6 +358,18 @@ parse_control_opt(char *argv[])
 		data_set_limit = limit;
 		return 2;	// We grabbed 2 options
 	}
+	if (!strcmp(argv[0], "-H")) {
+		huge_pages = true;
+		return 1;
+	}
+	if (!strcmp(argv[0], "-i")) {
+		load_path = argv[1];
+		return 2;
+	}
+	if (!strcmp(argv[0], "-O")) {
+		save_path = argv[1];
+		return 2;
+	}
 	if (!strcmp(argv[0], "-x")) {
 		quick_test = 0;
 		return 1;
@@ -531,26 +572,125 @@ fillset(struct item *a, size_t n)
 } // fillset
 
 
+// Maps in a data set that was saved with -O.  The mapping is read-only, and
+// each run copies it out before sorting, so every run sees the very same data
+static struct item *
+load_set(const char *path, size_t *n)
+{
+	struct stat st;
+	struct item *set;
+	int	fd;
+
+	if ((fd = open(path, O_RDONLY)) < 0) {
+		fprintf(stderr, "Unable to open %s: %s\n", path, strerror(errno));
+		exit(-1);
+	}
+
+	if (fstat(fd, &st) < 0) {
+		fprintf(stderr, "Unable to stat %s: %s\n", path, strerror(errno));
+		exit(-1);
+	}
+
+	if ((st.st_size == 0) || ((st.st_size % sizeof(*set)) != 0)) {
+		fprintf(stderr, "%s is not a whole number of %lu byte items\n", path, sizeof(*set));
+		exit(-1);
+	}
+
+	set = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (set == MAP_FAILED) {
+		fprintf(stderr, "Unable to map %s: %s\n", path, strerror(errno));
+		exit(-1);
+	}
+	madvise(set, st.st_size, MADV_WILLNEED);
+	close(fd);
+
+	*n = st.st_size / sizeof(*set);
+	return set;
+} // load_set
+
+
+// Allocates the array to be sorted.  With -H, it is mapped with huge_map(),
+// the same as ForSort's own large work-spaces are
+static struct item *
+alloc_set(size_t size)
+{
+	if (!huge_pages)
+		return aligned_alloc(4096, size);
+
+	enum huge_kind kind;
+	void	*p = huge_map(size, &kind);
+
+	if (p == NULL)
+		return NULL;
+
+	if (kind == HUGE_HUGETLB)
+		printf("Data set is backed by hugetlb pages\n");
+	else if (kind == HUGE_THP)
+		printf("Data set is backed by transparent huge pages\n");
+	else
+		printf("Huge pages are not available\n");
+	return p;
+} // alloc_set
+
+
+static void
+free_set(struct item *a, size_t size)
+{
+	if (!huge_pages)
+		return free(a);
+
+	huge_unmap(a, size);
+} // free_set
+
+
+static void
+save_set(const char *path, struct item *a, size_t n)
+{
+	FILE	*fp;
+
+	if ((fp = fopen(path, "wb")) == NULL) {
+		fprintf(stderr, "Unable to create %s: %s\n", path, strerror(errno));
+		exit(-1);
+	}
+
+	if ((fwrite(a, sizeof(*a), n, fp) != n) || (fclose(fp) != 0)) {
+		fprintf(stderr, "Unable to write %s: %s\n", path, strerror(errno));
+		exit(-1);
+	}
+} // save_set
+
+
 int
 main(int argc, char *argv[])
 {
-	size_t		n;
-	struct item	*a;
+	size_t		n, nset = 0;
+	struct item	*a, *set = NULL;
 	int		optpos = 1;
 
 	if(argc < 3) {
 		usage(argv[0], "Incorrect number of arguments");
 	}
 
-	while ((strlen(argv[optpos]) == 2) && !isdigit(argv[optpos][0])) {
+	while ((optpos < argc) && (strlen(argv[optpos]) == 2) && !isdigit(argv[optpos][0])) {
 		optpos += parse_control_opt(argv + optpos);
 	}
 
 	if (sorttype == SORT_UNKNOWN)
 		usage(argv[0], "Unknown sort type");
 
-	// Determine the size of the array we'll be sorting
-	if ((n = atol(argv[optpos++])) < 1) {
+	if (load_path)
+		set = load_set(load_path, &nset);
+
+	if ((optpos >= argc) && (set == NULL))
+		usage(argv[0], "Incorrect number of arguments");
+
+	// Determine the size of the array we'll be sorting.  A loaded data set
+	// caps it, and provides it if it wasn't given
+	n = (optpos < argc) ? atol(argv[optpos++]) : nset;
+	if (set && (n > nset))
+		n = nset;
+
+	if (n < 1) {
 		fprintf(stderr, "Please use values of 1 or greater for the number of elements\n");
 		exit(-1);
 	}
@@ -579,27 +719,34 @@ main(int argc, char *argv[])
 	srandom(random_seed);
 
 	// Allocate up the array to sort
-	if ((a = (struct item *)aligned_alloc(4096, n * sizeof(*a))) == NULL) {
+	if ((a = alloc_set(n * sizeof(*a))) == NULL) {
 		fprintf(stderr, "alloc failed - out of memory\n");
 		exit(-1);
 	}
 	// Now populate the array according to the command line options
 	printf("\nPopulating array of size: %lu\n\n", n);
 	printf("Item Size: %lu bytes\n", sizeof(*a));
-	printf("Data value range is 0..%u (inclusive)\n", data_set_limit - 1);
-	if (disorder_factor == 0) {
-		printf("Data set is ordered\n");
+	if (set) {
+		printf("Data set is loaded from: %s\n", load_path);
 	} else {
-		printf("Data set is disordered with factor: %d%%\n", disorder_factor);
-	}
-	if (data_set_ops & DATA_SET_UNIQUE) {
-		printf("All data values are unique\n");
-	} else {
-		printf("Duplicate data values are allowed in the set\n");
+		printf("Data value range is 0..%u (inclusive)\n", data_set_limit - 1);
+		if (disorder_factor == 0) {
+			printf("Data set is ordered\n");
+		} else {
+			printf("Data set is disordered with factor: %d%%\n", disorder_factor);
+		}
+		if (data_set_ops & DATA_SET_UNIQUE) {
+			printf("All data values are unique\n");
+		} else {
+			printf("Duplicate data values are allowed in the set\n");
+		}
 	}
-	if (data_set_ops & DATA_SET_REVERSED) {
+	if ((data_set_ops & DATA_SET_REVERSED) && !set) {
 		printf("Data set is reversed\n");
 	}
+	if (save_path) {
+		printf("Data set is saved to: %s\n", save_path);
+	}
 
 #if USE32BIT
 	printf("Using 32-bit items. Sort stability testing is disabled\n");
@@ -625,6 +772,15 @@ main(int argc, char *argv[])
 		}
 	}
 
+	forsort_ctx_t *ctx = NULL;
+
+	if (sorttype == FORSORT_CONTEXT) {
+		if ((ctx = forsort_ctx_create(NULL)) == NULL) {
+			fprintf(stderr, "Failed to create a sort context\n");
+			exit(-1);
+		}
+	}
+
 	double	total_time = 0;
 	double	run_time = 0;
 	size_t	num_runs = 0;
@@ -646,9 +802,22 @@ main(int argc, char *argv[])
 
 		num_runs++;
 
-		memset(a, 0, n * sizeof(*a));
-		srandom((uint32_t)num_runs);
-		fillset(a, n);
+		if (set) {
+			memcpy(a, set, n * sizeof(*a));
+#if (USE32BIT == 0)
+			// Saved data sets may come from elsewhere, so re-apply
+			// the stability tagging
+			for (uint32_t i = 0; i < n; i++)
+				a[i].order = i;
+#endif
+		} else {
+			memset(a, 0, n * sizeof(*a));
+			srandom((uint32_t)num_runs);
+			fillset(a, n);
+		}
+
+		if (save_path && (num_runs == 1))
+			save_set(save_path, a, n);
 
 		if (verbose) {
 			print_array(a, n);
@@ -690,6 +859,12 @@ main(int argc, char *argv[])
 		case FORSORT_STABLE:
 			forsort_stable(a, n, sizeof(*a), is_less_than_uint32);
 			break;
+		case FORSORT_PARALLEL:
+			forsort_parallel(a, n, sizeof(*a), is_less_than_uint32, 0);
+			break;
+		case FORSORT_CONTEXT:
+			forsort_inplace_ctx(ctx, a, n, sizeof(*a), is_less_than_uint32);
+			break;
 		default:
 			printf("ERROR: Unknown sort type\n");
 			exit(1);
@@ -721,6 +896,8 @@ main(int argc, char *argv[])
 			break;
 	}
 
+	forsort_ctx_destroy(ctx);
+
 	if (workspace) {
 		free(workspace);
 		worksize = 0;
@@ -745,5 +922,8 @@ main(int argc, char *argv[])
 	printf("Avg ns per item          : %.3fns\n", ((total_time / num_runs) * 1000000000) / n);
 	printf("\n");
 
-	free(a);
+	if (set)
+		munmap(set, nset * sizeof(*set));
+
+	free_set(a, n * sizeof(*a));
 } /* main */